@@ -0,0 +1,298 @@
+//Concurrent pyramid sort
+
+#include <climits>	//INT_MIN
+#include <algorithm>	//sort, upper_bound, reverse, copy
+#include <thread>
+#include <vector>
+#include "k-way-merge.h"
+#include "concurrent-pyramid-sort.h"
+
+
+/****************************************************************
+CONCURRENT PYRAMID***********************************************
+*****************************************************************
+-A single pyramid can't take inserts from several threads without locking: each insertion can promote all the way up to the superParent, so an insert
+	would have to lock every container it might promote into, which is the whole path from the superParent down whenever the bottom container is full.
+	Rather than lock single containers, the values are split by range into shards, each a separate pyramid (a PyramidQueue) behind its own lock.
+	Threads only wait on each other when they insert into the same shard at the same time, which with many more shards than threads is rare.
+-Each shard's PyramidQueue has a pool of its own, so the containers a thread takes while holding a shard's lock are only ever used by that shard, and
+	taking one never contends with other shards.
+-The shards split the values by range, so the shards placed one after another in order hold the values in order. The ranges are set when the pyramid
+	is created, from a sample of the values when there is one, and a shard that gets large is split in two, so the shards follow the values 
+	actually inserted. A shard over splitLength values is split at its middle value, by taking out its values in order 
+	and building two new pyramids from them in linear time, which is done holding the lock on the table of shards exclusively. Inserts hold that
+	lock shared, only long enough to find their shard and insert into it. A shard whose values are all equal can't be split, and waits until it
+	has twice as many values before trying again.
+-Splitting doesn't help values that keep rising, like timestamps: every new value is above all the splitters and goes to the last shard.
+-Inserting a group of values sorts them by shard first (a counting sort), so each shard's lock is taken once for all of its values in the group.
+*****************************************************************/
+
+
+const int concurrentInsertGroupLength = 4096;	//Values each thread of concurrentPyramidSort groups by shard at a time
+const int samplesPerShard = 32;	//Sample values taken by concurrentPyramidSort for each shard
+
+
+ConcurrentPyramid::ConcurrentPyramid(int numShards){
+	allocateShards(numShards);
+	
+	//the range of int split evenly
+	for(int i = 1;i < numShards;++i){
+		splitters[i - 1] = (int)(INT_MIN + (long)i * ((long)UINT_MAX + 1) / numShards);
+	}
+}
+
+ConcurrentPyramid::ConcurrentPyramid(const int* sample, int sampleLength, int numShards){
+	allocateShards(numShards);
+	
+	//the sorted sample split evenly
+	int* sortedSample = new int[sampleLength];
+	std::copy(sample, sample + sampleLength, sortedSample);
+	std::sort(sortedSample, sortedSample + sampleLength);
+	for(int i = 1;i < numShards;++i){
+		splitters[i - 1] = (sampleLength > 0) ? sortedSample[(long)i * sampleLength / numShards] : 0;
+	}
+	delete[] sortedSample;
+}
+
+void ConcurrentPyramid::allocateShards(int numShards){
+	this->numShards = numShards;
+	shardsLength = std::max(numShards, maxShards);
+	splitters = new int[shardsLength];
+	shards = new shard*[shardsLength];
+	for(int i = 0;i < numShards;++i){
+		shards[i] = new shard();
+	}
+}
+
+ConcurrentPyramid::~ConcurrentPyramid(){
+	for(int i = 0;i < numShards;++i){
+		delete shards[i];
+	}
+	delete[] shards;
+	delete[] splitters;
+}
+
+
+//The shard a value belongs in: the last shard whose lowest value is at most the value
+int ConcurrentPyramid::shardOf(int value) const{
+	return (int)(std::upper_bound(splitters, splitters + numShards - 1, value) - splitters);
+}
+
+//Whether a shard should be split. Called holding the shard's lock
+bool ConcurrentPyramid::isHot(const shard* destination) const{
+	return destination->pyramid.size() > destination->splitLength && numShards < shardsLength;
+}
+
+
+//Split the shard a value belongs in at its middle value, if it still needs splitting once the table of shards is locked
+void ConcurrentPyramid::splitShardOf(int value){
+	std::unique_lock<std::shared_mutex> tableGuard(shardsLock);
+	int index = shardOf(value);
+	shard* hot = shards[index];
+	if(!isHot(hot))
+		return;
+	
+	int length = hot->pyramid.size();
+	int* values = new int[length];
+	hot->pyramid.topK(length, values);	//from highest to lowest
+	std::reverse(values, values + length);
+	
+	//the higher shard starts at the middle value, or after it if the values below the middle are all equal to it
+	int middle = (int)(std::lower_bound(values, values + length, values[length / 2]) - values);
+	if(middle == 0)
+		middle = (int)(std::upper_bound(values, values + length, values[length / 2]) - values);
+	if(middle == length){
+		hot->splitLength *= 2;
+		delete[] values;
+		return;
+	}
+	
+	shard* lower = new shard(values, middle);
+	shard* higher = new shard(values + middle, length - middle);
+	delete[] values;
+	delete hot;
+	
+	for(int i = numShards;i > index + 1;--i){
+		shards[i] = shards[i - 1];
+		splitters[i - 1] = splitters[i - 2];
+	}
+	shards[index] = lower;
+	shards[index + 1] = higher;
+	splitters[index] = higher->pyramid.min();
+	++numShards;
+}
+
+
+void ConcurrentPyramid::insert(int value){
+	bool isSplitNeeded;
+	{
+		std::shared_lock<std::shared_mutex> tableGuard(shardsLock);
+		shard& destination = *shards[shardOf(value)];
+		std::lock_guard<std::mutex> guard(destination.lock);
+		destination.pyramid.push(value);
+		isSplitNeeded = isHot(&destination);
+	}
+	if(isSplitNeeded)
+		splitShardOf(value);
+}
+
+void ConcurrentPyramid::insert(const int* values, int length){
+	int* hotValues = new int[std::min(length, maxShards)];	//A value in each shard to split
+	int numHotValues = 0;
+	{
+		std::shared_lock<std::shared_mutex> tableGuard(shardsLock);
+		
+		//count the values for each shard, then place them in groups by shard
+		int* shardStart = new int[numShards + 1]();
+		int* valueShard = new int[length];
+		for(int i = 0;i < length;++i){
+			valueShard[i] = shardOf(values[i]);
+			++shardStart[valueShard[i] + 1];
+		}
+		for(int i = 0;i < numShards;++i){
+			shardStart[i + 1] += shardStart[i];
+		}
+		
+		int* groupedValues = new int[length];
+		int* position = new int[numShards];
+		std::copy(shardStart, shardStart + numShards, position);
+		for(int i = 0;i < length;++i){
+			groupedValues[position[valueShard[i]]++] = values[i];
+		}
+		
+		//insert each group under its shard's lock
+		for(int i = 0;i < numShards;++i){
+			if(shardStart[i] == shardStart[i + 1])
+				continue;
+			
+			std::lock_guard<std::mutex> guard(shards[i]->lock);
+			for(int j = shardStart[i];j < shardStart[i + 1];++j){
+				shards[i]->pyramid.push(groupedValues[j]);
+			}
+			if(isHot(shards[i]) && numHotValues < maxShards)
+				hotValues[numHotValues++] = groupedValues[shardStart[i]];
+		}
+		
+		delete[] shardStart;
+		delete[] valueShard;
+		delete[] groupedValues;
+		delete[] position;
+	}
+	
+	for(int i = 0;i < numHotValues;++i){
+		splitShardOf(hotValues[i]);
+	}
+	delete[] hotValues;
+}
+
+
+long ConcurrentPyramid::size() const{
+	std::shared_lock<std::shared_mutex> tableGuard(shardsLock);
+	long totalSize = 0;
+	for(int i = 0;i < numShards;++i){
+		std::lock_guard<std::mutex> guard(shards[i]->lock);
+		totalSize += shards[i]->pyramid.size();
+	}
+	return totalSize;
+}
+
+int ConcurrentPyramid::shardCount() const{
+	std::shared_lock<std::shared_mutex> tableGuard(shardsLock);
+	return numShards;
+}
+
+long ConcurrentPyramid::placeElementsInArray(int* array) const{
+	std::shared_lock<std::shared_mutex> tableGuard(shardsLock);
+	long index = 0;
+	for(int i = 0;i < numShards;++i){
+		std::lock_guard<std::mutex> guard(shards[i]->lock);
+		int shardSize = shards[i]->pyramid.size();
+		shards[i]->pyramid.topK(shardSize, array + index);	//from highest to lowest
+		std::reverse(array + index, array + index + shardSize);
+		index += shardSize;
+	}
+	return index;
+}
+
+
+//Sort an array
+void concurrentPyramidSort(int* array, int arrayLength, int numThreads){
+	if(arrayLength <= 1)
+		return;
+	
+	//sample values spread through the array to split the shards
+	int numShards = 8 * numThreads;
+	int sampleLength = std::min(arrayLength, numShards * samplesPerShard);
+	int* sample = new int[sampleLength];
+	for(int i = 0;i < sampleLength;++i){
+		sample[i] = array[(long)i * arrayLength / sampleLength];
+	}
+	ConcurrentPyramid pyramid(sample, sampleLength, numShards);
+	delete[] sample;
+	
+	//each thread inserts its own part of the array
+	std::vector<std::thread> threads;
+	for(int t = 0;t < numThreads;++t){
+		int start = (int)((long)t * arrayLength / numThreads);
+		int end = (int)((long)(t + 1) * arrayLength / numThreads);
+		threads.emplace_back([&pyramid, array, start, end](){
+			for(int i = start;i < end;i += concurrentInsertGroupLength){
+				pyramid.insert(array + i, std::min(concurrentInsertGroupLength, end - i));
+			}
+		});
+	}
+	for(std::thread& thread : threads){
+		thread.join();
+	}
+	
+	pyramid.placeElementsInArray(array);
+}
+
+
+
+/****************************************************************
+PARALLEL PYRAMID SORT********************************************
+*****************************************************************
+-Sorting a whole array doesn't need the pyramids to be shared: each thread sorts its own part of the array with pyramidSort, with a block of
+	containers it allocates itself. The block is first written by the thread that uses it, so on a machine with memory for each processor, 
+	each thread's containers are placed in the memory of its own processor.
+-The sorted parts are then merged by all of the threads with parallelMergeParts (k-way-merge.h), each merging an equal share of the values of
+	each pass however the values are spread between the parts.
+*****************************************************************/
+
+
+const int minParallelSortLength = 1 << 16;	//Shorter arrays are sorted by pyramidSort alone
+
+
+//Sort an array
+void parallelPyramidSort(int* array, int arrayLength, int numThreads){
+	if(numThreads <= 1 || arrayLength < minParallelSortLength){
+		pyramidSort(array, arrayLength);
+		return;
+	}
+
+	//each thread sorts its part with containers of its own
+	long* partStart = new long[numThreads + 1];
+	for(int t = 0;t <= numThreads;++t){
+		partStart[t] = (long)t * arrayLength / numThreads;
+	}
+	std::vector<std::thread> threads;
+	for(int t = 0;t < numThreads;++t){
+		threads.emplace_back([=](){
+			int partLength = (int)(partStart[t + 1] - partStart[t]);
+			elementContainer* containers;
+			allocateMemory(partLength, containers);
+			pyramidSort(array + partStart[t], partLength, containers);
+			deallocateMemory(containers);
+		});
+	}
+	for(std::thread& thread : threads){
+		thread.join();
+	}
+
+	int* buffer = new int[arrayLength];
+	parallelMergeParts(array, partStart, numThreads, buffer, numThreads);
+
+	delete[] partStart;
+	delete[] buffer;
+}
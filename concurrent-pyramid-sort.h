@@ -0,0 +1,61 @@
+
+#ifndef concurrent_pyramid_sort
+#define concurrent_pyramid_sort
+
+#include <mutex>
+#include <shared_mutex>
+#include "pyramid-sort.h"
+
+
+//Pyramid that several threads can insert into at once. Values are split by range between shards, each a PyramidQueue with its own pool of
+	//containers and its own lock, so threads inserting into different shards don't wait on each other. A shard that gets large is split in two at
+	//its middle value, so the shards follow the values inserted whatever range they are in, up to maxShards of them.
+	//Values that keep rising (or falling), like timestamps, all go to the last (or first) shard however the shards are split, so their writers
+	//take turns on its lock: threads inserting such values gain nothing from a ConcurrentPyramid over a PyramidQueue behind one lock.
+	//Inserting a value costs more than in pyramidSort (like a PyramidQueue's push, about 3 times as much), so a whole array is faster sorted with 
+	//parallelPyramidSort
+class ConcurrentPyramid {
+	public:
+	static constexpr int maxShards = 4096;	//Shards stop splitting once there are this many (or numShards if more)
+	static constexpr int minSplitLength = 1 << 16;	//Values a shard holds before it is split
+
+	ConcurrentPyramid(int numShards = 64);	//Shards split the range of int evenly until they are split by the values inserted
+	ConcurrentPyramid(const int* sample, int sampleLength, int numShards = 64);	//Shards split the values in sample evenly
+	~ConcurrentPyramid();
+	ConcurrentPyramid(const ConcurrentPyramid&) = delete;
+	ConcurrentPyramid& operator=(const ConcurrentPyramid&) = delete;
+
+	void insert(int value);
+	void insert(const int* values, int length);	//Groups the values by shard first, taking each shard's lock once
+	long size() const;
+	int shardCount() const;
+	long placeElementsInArray(int* array) const;	//Writes the values from lowest to highest, returns how many were written. Meant for once inserts are done
+
+	private:
+	struct alignas(64) shard {	//Each shard in its own cache lines, so that locking one doesn't contend with its neighbours
+		mutable std::mutex lock;
+		PyramidQueue pyramid;
+		int splitLength = minSplitLength;	//Doubled when the shard can't be split, because all of its values are equal
+
+		shard(const int* values = nullptr, int length = 0) : pyramid(values, length) {}
+	};
+
+	mutable std::shared_mutex shardsLock;	//Held shared to find a shard and insert into it, and exclusively to split one
+	int numShards;
+	int shardsLength;
+	int* splitters;	//The lowest value of each shard after the first, from lowest to highest
+	shard** shards;
+
+	void allocateShards(int numShards);
+	int shardOf(int value) const;
+	bool isHot(const shard* destination) const;
+	void splitShardOf(int value);
+};
+
+
+//Sort an array with numThreads threads inserting into a ConcurrentPyramid
+void concurrentPyramidSort(int* array, int arrayLength, int numThreads);
+//Sort an array with numThreads threads, each sorting a part of it with pyramidSort, then merge the parts with all of them
+void parallelPyramidSort(int* array, int arrayLength, int numThreads);
+
+#endif
@@ -0,0 +1,366 @@
+//External sort
+
+//Generate runs by replacement selection through PyramidQueues rather than sorting them a memory full at a time
+//#define REPLACEMENT_SELECTION
+//Report the memory replacement selection took, against the budget
+//#define DIAGNOSTICS
+
+#include <climits>	//INT_MAX
+#include <cstring>	//memcpy
+#include <string>
+#include <thread>
+#include <algorithm>	//min, max, swap
+#include <fcntl.h>	//open
+#include <sys/mman.h>	//madvise
+#include <unistd.h>	//pread, pwrite, mkstemp, unlink
+#ifdef DIAGNOSTICS
+#include <iostream>
+#endif
+#include "pyramid-sort.h"
+#include "number-loader.h"
+#include "k-way-merge.h"
+#include "external-sort.h"
+
+
+/****************************************************************
+EXTERNAL SORT****************************************************
+*****************************************************************
+-For values that don't fit in memory, the input is sorted a run at a time: as many values as fit in the memory budget are sorted with pyramidSort
+	and written to a temporary file, and the sorted runs are then merged into the output.
+-The memory budget covers two run buffers and pyramidSort's containers. While one run is sorted, the other is written by a background thread, and 
+	the input for the next run is requested from the kernel ahead of time (madvise), so reading and writing overlap with sorting.
+-With REPLACEMENT_SELECTION defined, runs are generated by replacement selection instead. A PyramidQueue holds as many values as fit in the budget,
+	and its lowest value is written out, replaced by the next value of the input. A value lower than the last one written can't join the run, so it 
+	waits in a second PyramidQueue for the next run, which starts when the first is empty. Sorted input is a single run.
+-The queues share a pool, so the containers the run gives back as it shrinks hold the values waiting for the next run, and the two together 
+	never take more than a container (48 bytes) for each value held. The budget then holds about as many values as a sorted run, whose containers
+	take the same and its two buffers the rest, and on random input the runs come out about 1.7 times as long as sorted runs.
+-Runs are merged with a LoserTree (k-way-merge.h), a leaf for each run. Each run is read in large blocks, and the merged values are written a 
+	block at a time by a background thread.
+-Each run needs a read block of its own, so with many runs and a small budget the blocks would get too small for sequential reads. Then runs are
+	merged in groups into a second temporary file, which takes up the same place in it as the runs, until few enough are left to merge at once.
+*****************************************************************/
+
+
+const long minMergeBlockBytes = 1 << 20;	//The smallest read block for each run being merged
+const long exhaustedRun = LoserTree::exhausted;	//The head of a run with no values left
+const long selectionOutputShare = 8;	//Replacement selection's output buffers take 1/8 of the memory budget, the PyramidQueues the rest
+
+
+//Write length values at a value offset in file in the background. Waiting for the write to finish before the next one keeps one buffer being 
+	//written while the other is filled
+struct backgroundWriter {
+	std::thread writing;
+	bool isWritten = true;
+	
+	void write(int file, long byteOffset, const int* values, long length, NumbersChecksum* checksum = nullptr){
+		wait();
+		writing = std::thread([=](){
+			if(checksum != nullptr)
+				checksum->add(values, length);
+			
+			const char* bytes = (const char*)values;
+			long remaining = length * sizeof(int);
+			long offset = byteOffset;
+			while(remaining > 0 && isWritten){
+				long written = pwrite(file, bytes, remaining, offset);
+				isWritten = written > 0;
+				bytes += written;
+				offset += written;
+				remaining -= written;
+			}
+		});
+	}
+	
+	bool wait(){
+		if(writing.joinable())
+			writing.join();
+		return isWritten;
+	}
+};
+
+
+//A run being merged, read a block at a time
+struct runReader {
+	int file;
+	long nextOffset;	//Byte offset of the values not read yet
+	long remaining;	//Values not read yet
+	int* block;
+	long blockLength;
+	long position;
+	long filled;
+	
+	//The next value, or exhaustedRun
+	long next(){
+		if(position == filled){
+			if(remaining == 0)
+				return exhaustedRun;
+			
+			long length = std::min(blockLength, remaining);
+			long read = 0;
+			while(read < length * (long)sizeof(int)){
+				long bytes = pread(file, (char*)block + read, length * sizeof(int) - read, nextOffset + read);
+				if(bytes <= 0)
+					return exhaustedRun;
+				read += bytes;
+			}
+			nextOffset += read;
+			remaining -= length;
+			position = 0;
+			filled = length;
+		}
+		return block[position++];
+	}
+};
+
+
+//Merge the runs from runStart[0] to runStart[numRuns] (value offsets in sourceFile) into destination from destinationOffset (a byte offset), 
+	//using memory for blocks of blockLength values: one for each run and two for the output
+bool mergeRuns(int sourceFile, const long* runStart, int numRuns, int destination, long destinationOffset, int* memory, long blockLength, 
+		NumbersChecksum* checksum){
+	runReader* runs = new runReader[numRuns];
+	for(int i = 0;i < numRuns;++i){
+		runs[i].file = sourceFile;
+		runs[i].nextOffset = runStart[i] * sizeof(int);
+		runs[i].remaining = runStart[i + 1] - runStart[i];
+		runs[i].block = memory + i * blockLength;
+		runs[i].blockLength = blockLength;
+		runs[i].position = 0;
+		runs[i].filled = 0;
+	}
+	
+	long* heads = new long[numRuns];
+	for(int i = 0;i < numRuns;++i){
+		heads[i] = runs[i].next();
+	}
+	LoserTree tree(heads, numRuns);
+	delete[] heads;
+	
+	int* output = memory + numRuns * blockLength;
+	int* writtenOutput = output + blockLength;
+	long outputLength = 0;
+	backgroundWriter writer;
+	while(!tree.empty()){
+		int winner = tree.winner();
+		output[outputLength++] = tree.winnerValue();
+		if(outputLength == blockLength){
+			writer.write(destination, destinationOffset, output, outputLength, checksum);
+			destinationOffset += outputLength * sizeof(int);
+			std::swap(output, writtenOutput);
+			outputLength = 0;
+		}
+		tree.replaceWinner(runs[winner].next());
+	}
+	
+	//a run that couldn't be read stops short, leaving values unmerged
+	bool isMerged = true;
+	for(int i = 0;i < numRuns;++i){
+		isMerged = isMerged && runs[i].remaining == 0;
+	}
+	writer.write(destination, destinationOffset, output, outputLength, checksum);
+	isMerged = writer.wait() && isMerged;
+	
+	delete[] runs;
+	return isMerged;
+}
+
+
+//Sort the values runLength at a time into runs in runFile, sorting a run while the last one is written. Returns false if they can't be written
+bool sortRuns(const int* values, long numValues, long runLength, int runFile, long*& runStart, int& numRuns){
+	numRuns = (int)((numValues + runLength - 1) / runLength);
+	runStart = new long[numRuns + 1];
+	int* runBuffer = new int[runLength];
+	int* writtenRunBuffer = new int[runLength];
+	elementContainer* containers;
+	allocateMemory((int)runLength, containers);
+	backgroundWriter writer;
+	for(int run = 0;run < numRuns;++run){
+		runStart[run] = run * runLength;
+		long length = std::min(runLength, numValues - runStart[run]);
+		if(run + 1 < numRuns){
+			const char* nextRun = (const char*)(values + runStart[run] + runLength);
+			long pageOffset = (long)nextRun % sysconf(_SC_PAGESIZE);
+			madvise((void*)(nextRun - pageOffset), pageOffset + std::min(runLength, numValues - runStart[run] - runLength) * sizeof(int), MADV_WILLNEED);
+		}
+		
+		memcpy(runBuffer, values + runStart[run], length * sizeof(int));
+		pyramidSort(runBuffer, (int)length, containers);
+		writer.write(runFile, runStart[run] * sizeof(int), runBuffer, length);
+		std::swap(runBuffer, writtenRunBuffer);
+	}
+	runStart[numRuns] = numValues;
+	bool isWritten = writer.wait();
+	
+	deallocateMemory(containers);
+	delete[] runBuffer;
+	delete[] writtenRunBuffer;
+	return isWritten;
+}
+
+
+//Stream the values through two PyramidQueues into runs in runFile by replacement selection. Returns false if they can't be written
+bool selectRuns(const int* values, long numValues, long memoryBudget, int runFile, long*& runStart, int& numRuns){
+	long outputLength = std::max(1l, memoryBudget / selectionOutputShare / (2 * (long)sizeof(int)));
+	long capacity = std::max(1l, (memoryBudget - 2 * outputLength * (long)sizeof(int)) / containerMemoryBytes(1));
+	int* output = new int[outputLength];
+	int* writtenOutput = new int[outputLength];
+	long outputUsed = 0;
+	long written = 0;
+	backgroundWriter writer;
+	
+	int runStartLength = 16;
+	runStart = new long[runStartLength];
+	numRuns = 0;
+	
+	//the queues share a pool, so the containers the run gives back as it empties hold the values waiting for the next run
+	PyramidPool pool;
+	PyramidQueue* run = new PyramidQueue(&pool);
+	PyramidQueue* nextRun = new PyramidQueue(&pool);
+	long read = 0;
+	for(;read < std::min(capacity, numValues);++read){
+		run->push(values[read]);
+	}
+	
+	while(!run->empty()){
+		if(numRuns + 1 == runStartLength){
+			long* grownRunStart = new long[2 * runStartLength];
+			std::copy(runStart, runStart + numRuns, grownRunStart);
+			delete[] runStart;
+			runStart = grownRunStart;
+			runStartLength *= 2;
+		}
+		runStart[numRuns++] = written + outputUsed;
+		
+		//take the lowest value while values that can still follow it join the run, and the rest wait for the next run
+		while(!run->empty()){
+			int lowest = run->popMin();
+			output[outputUsed++] = lowest;
+			if(outputUsed == outputLength){
+				writer.write(runFile, written * sizeof(int), output, outputUsed);
+				written += outputUsed;
+				std::swap(output, writtenOutput);
+				outputUsed = 0;
+			}
+			
+			if(read < numValues){
+				int value = values[read++];
+				if(value >= lowest)
+					run->push(value);
+				else
+					nextRun->push(value);
+			}
+		}
+		std::swap(run, nextRun);
+	}
+	writer.write(runFile, written * sizeof(int), output, outputUsed);
+	runStart[numRuns] = numValues;
+	bool isWritten = writer.wait();
+	
+	#ifdef DIAGNOSTICS
+	std::cout << "Replacement selection took " << pool.reservedBytes() + 2 * outputLength * sizeof(int) << " bytes of a budget of " << memoryBudget 
+		<< ", for " << numRuns << " runs\n";
+	#endif
+	
+	delete run;
+	delete nextRun;
+	delete[] output;
+	delete[] writtenOutput;
+	return isWritten;
+}
+
+
+//Open an unnamed temporary file in directory, removed once it is closed
+int openTemporaryFile(const char* directory){
+	std::string path = std::string(directory) + "/external-sort-XXXXXX";
+	int file = mkstemp(&path[0]);
+	if(file >= 0)
+		unlink(path.c_str());
+	return file;
+}
+
+
+bool externalSort(const char* inputPath, const char* outputPath, long memoryBudget, const char* tempDirectory){
+	MappedNumbers input(inputPath);
+	if(input.values() == nullptr)
+		return false;
+	const int* values = input.values();
+	long numValues = input.size();
+	
+	int output = open(outputPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if(output < 0)
+		return false;
+	memoryBudget = std::max(memoryBudget, minExternalSortBudget);
+	
+	//each value of a run takes its place in the two run buffers and its container
+	long bytesPerValue = 2 * sizeof(int) + containerMemoryBytes(1);
+	long runLength = std::max(2l, std::min(memoryBudget / bytesPerValue, (long)INT_MAX));
+	NumbersChecksum checksum;
+	bool isDone;
+	
+	//values that fit in one run are sorted and written out directly
+	if(numValues <= runLength){
+		int* array = new int[numValues];
+		memcpy(array, values, numValues * sizeof(int));
+		pyramidSort(array, (int)numValues);
+		backgroundWriter writer;
+		writer.write(output, numbersHeaderLength, array, numValues, &checksum);
+		isDone = writer.wait();
+		delete[] array;
+	}
+	else{
+		int runFile = openTemporaryFile(tempDirectory);
+		if(runFile < 0){
+			close(output);
+			return false;
+		}
+		
+		long* runStart;
+		int numRuns;
+		#ifdef REPLACEMENT_SELECTION
+		isDone = selectRuns(values, numValues, memoryBudget, runFile, runStart, numRuns);
+		#else
+		isDone = sortRuns(values, numValues, runLength, runFile, runStart, numRuns);
+		#endif
+		
+		//merge runs in groups until they can all be merged at once with blocks of at least minMergeBlockBytes
+		int maxRunsMerged = std::max(2l, memoryBudget / minMergeBlockBytes - 2);
+		int* mergeMemory = nullptr;
+		int mergeFile = -1;
+		while(isDone && numRuns > maxRunsMerged){
+			if(mergeFile < 0)
+				mergeFile = openTemporaryFile(tempDirectory);
+			if(mergeFile < 0){
+				isDone = false;
+				break;
+			}
+			
+			long blockLength = std::max(1l, memoryBudget / (long)sizeof(int) / (maxRunsMerged + 2));
+			mergeMemory = (mergeMemory != nullptr) ? mergeMemory : new int[blockLength * (maxRunsMerged + 2)];
+			int numMerged = 0;
+			for(int first = 0;first < numRuns && isDone;first += maxRunsMerged){
+				int groupRuns = std::min(maxRunsMerged, numRuns - first);
+				isDone = mergeRuns(runFile, runStart + first, groupRuns, mergeFile, runStart[first] * sizeof(int), mergeMemory, blockLength, nullptr);
+				runStart[numMerged++] = runStart[first];
+			}
+			runStart[numMerged] = numValues;
+			numRuns = numMerged;
+			std::swap(runFile, mergeFile);
+		}
+		delete[] mergeMemory;
+		
+		if(isDone){
+			long blockLength = std::max(1l, memoryBudget / (long)sizeof(int) / (numRuns + 2));
+			mergeMemory = new int[blockLength * (numRuns + 2)];
+			isDone = mergeRuns(runFile, runStart, numRuns, output, numbersHeaderLength, mergeMemory, blockLength, &checksum);
+			delete[] mergeMemory;
+		}
+		
+		close(runFile);
+		if(mergeFile >= 0)
+			close(mergeFile);
+		delete[] runStart;
+	}
+	
+	isDone = isDone && writeNumbersHeader(output, numValues, true, &checksum);
+	return (close(output) == 0) && isDone;
+}
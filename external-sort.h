@@ -0,0 +1,14 @@
+
+#ifndef external_sort
+#define external_sort
+
+
+//The least memory externalSort works in. Smaller budgets are raised to it, as runs of a few values would each need a read of their own to merge
+const long minExternalSortBudget = 1 << 16;
+
+//Sort the values of a binary numbers file (see number-loader.h) into another, in about memoryBudget bytes of memory (at least 
+	//minExternalSortBudget) however many values there are. Sorted runs are kept in a temporary file in tempDirectory, which is removed when the 
+	//sort is done. Returns false if a file can't be read or written
+bool externalSort(const char* inputPath, const char* outputPath, long memoryBudget, const char* tempDirectory = "/tmp");
+
+#endif
@@ -71,7 +71,7 @@ void treeSort(int *array, int arrayLength){
 	int numOverflows = 0;
 	
 	//Initialize
-	for(int i = 0;i < treeSize/2;++i){
+	for(int i = 0;i < treeSize;++i){
 		overflowContainers[i].count = 0;
 	}
 	for(int i = 0;i < treeSize;++i){
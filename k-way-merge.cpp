@@ -0,0 +1,289 @@
+//K-way merge
+
+#include <algorithm>	//copy, min, max
+#include <thread>
+#include <vector>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+#include "k-way-merge.h"
+
+
+/****************************************************************
+K-WAY MERGE******************************************************
+*****************************************************************
+-Merging sorted spans is what joins the parts of a sort done a part at a time, whether the parts were sorted by separate threads or were runs of an
+	external sort. Two spans are merged by mergeTwo. mergeSpans merges more than two with a loser tree over all of them at once, so each value is
+	read and written once however many spans there are, which is what a merge streaming from files needs. In memory, merging pairs of spans with
+	mergeTwo is faster even though it takes a pass for every doubling: with AVX2, 1024 spans take 10 passes of mergeTwo in a fifth of the time of
+	one pass of the loser tree, whose replay is a chain of dependent comparisons. So mergeParts, which has a buffer to merge into, merges pairs.
+-mergeTwo doesn't branch on the comparisons, which are as unpredictable as the values: the lower head is picked with a conditional move, and
+	whichever span it came from moves on by adding the comparison's result to its position.
+-Compiled with AVX2 (-mavx2), mergeTwo merges 8 values at a time. Two sorted vectors of 8 make a bitonic sequence when one is reversed, which a
+	bitonic merge sorts in 4 steps of a min and a max each. The lower 8 are written out, and the higher 8 are merged with the next 8 values of
+	whichever span has the lower next value, since everything that can still come before them is among those. The last values of each span, fewer
+	than 8, are merged one at a time.
+-The loser tree's keys put a source's number below its value in a long, so a match is a single comparison of two longs, and replaying the
+	winner's matches takes no branches (the keys are swapped with a mask, as a min and a max turn into a branch that fails half the time), and
+	nothing is looked up but the keys on the winner's path. Those are 8 bytes each, so the top levels of the tree, which every replay passes 
+	through, share a few cache lines.
+*****************************************************************/
+
+
+LoserTree::LoserTree(const long* heads, int numSources){
+	numLeaves = 1;
+	while(numLeaves < numSources){
+		numLeaves *= 2;
+	}
+
+	//play the matches from the leaves up, keeping the loser of each
+	losers = new long[numLeaves];
+	long* winners = new long[2 * numLeaves];
+	for(int i = 0;i < numLeaves;++i){
+		winners[numLeaves + i] = (i < numSources && heads[i] != exhausted) ? makeKey(heads[i], i) : exhausted;
+	}
+	for(int node = numLeaves - 1;node >= 1;--node){
+		winners[node] = std::min(winners[2 * node], winners[2 * node + 1]);
+		losers[node] = std::max(winners[2 * node], winners[2 * node + 1]);
+	}
+	losers[0] = winners[1];
+	delete[] winners;
+}
+
+LoserTree::~LoserTree(){
+	delete[] losers;
+}
+
+
+#ifdef __AVX2__
+//Sort a bitonic vector of 8 values
+inline __m256i bitonicSort8(__m256i values){
+	__m256i swapped = _mm256_permute2x128_si256(values, values, 1);	//distance 4
+	values = _mm256_blend_epi32(_mm256_min_epi32(values, swapped), _mm256_max_epi32(values, swapped), 0xF0);
+	swapped = _mm256_shuffle_epi32(values, _MM_SHUFFLE(1, 0, 3, 2));	//distance 2
+	values = _mm256_blend_epi32(_mm256_min_epi32(values, swapped), _mm256_max_epi32(values, swapped), 0xCC);
+	swapped = _mm256_shuffle_epi32(values, _MM_SHUFFLE(2, 3, 0, 1));	//distance 1
+	return _mm256_blend_epi32(_mm256_min_epi32(values, swapped), _mm256_max_epi32(values, swapped), 0xAA);
+}
+
+//Merge two sorted vectors of 8 values, lower getting the lowest 8 and higher the highest 8, both sorted
+inline void bitonicMerge8(__m256i& lower, __m256i& higher){
+	__m256i reversed = _mm256_permutevar8x32_epi32(higher, _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0));
+	__m256i low = _mm256_min_epi32(lower, reversed);
+	__m256i high = _mm256_max_epi32(lower, reversed);
+	lower = bitonicSort8(low);
+	higher = bitonicSort8(high);
+}
+#endif
+
+
+//Merge the spans one value at a time, picking the lower head without branching
+inline void mergeTwoScalar(const int* first, long firstLength, const int* second, long secondLength, int* destination){
+	long i = 0;
+	long j = 0;
+	while(i < firstLength && j < secondLength){
+		int firstValue = first[i];
+		int secondValue = second[j];
+		bool isSecondLower = secondValue < firstValue;
+		*destination++ = isSecondLower ? secondValue : firstValue;
+		j += isSecondLower;
+		i += !isSecondLower;
+	}
+	destination = std::copy(first + i, first + firstLength, destination);
+	std::copy(second + j, second + secondLength, destination);
+}
+
+
+void mergeTwo(const int* first, long firstLength, const int* second, long secondLength, int* destination){
+	#ifdef __AVX2__
+	if(firstLength >= 8 && secondLength >= 8){
+		__m256i lower = _mm256_loadu_si256((const __m256i*)first);
+		__m256i higher = _mm256_loadu_si256((const __m256i*)second);
+		long i = 8;
+		long j = 8;
+		while(true){
+			bitonicMerge8(lower, higher);
+			_mm256_storeu_si256((__m256i*)destination, lower);
+			destination += 8;
+
+			//the next 8 come from the span whose next value is lower
+			if(i + 8 > firstLength || j + 8 > secondLength)
+				break;
+			bool isSecondLower = second[j] < first[i];
+			const int* next = isSecondLower ? second + j : first + i;
+			j += isSecondLower ? 8 : 0;
+			i += isSecondLower ? 0 : 8;
+			lower = _mm256_loadu_si256((const __m256i*)next);
+		}
+
+		//the 8 held back are merged with what is left of both spans, one value at a time. A span with 8 or more left is merged with the others'
+			//values first, until it has none lower than theirs
+		alignas(32) int held[8];
+		_mm256_store_si256((__m256i*)held, higher);
+		int heldIndex = 0;
+		while(heldIndex < 8 && i < firstLength && j < secondLength){
+			int value = std::min(held[heldIndex], std::min(first[i], second[j]));
+			if(value == held[heldIndex])
+				++heldIndex;
+			else if(value == first[i])
+				++i;
+			else
+				++j;
+			*destination++ = value;
+		}
+		if(heldIndex == 8){
+			mergeTwoScalar(first + i, firstLength - i, second + j, secondLength - j, destination);
+		}
+		else if(i == firstLength){
+			mergeTwoScalar(held + heldIndex, 8 - heldIndex, second + j, secondLength - j, destination);
+		}
+		else{
+			mergeTwoScalar(held + heldIndex, 8 - heldIndex, first + i, firstLength - i, destination);
+		}
+		return;
+	}
+	#endif
+
+	mergeTwoScalar(first, firstLength, second, secondLength, destination);
+}
+
+
+void mergeSpans(const int* const* spans, const long* spanLengths, int numSpans, int* destination){
+	if(numSpans == 1){
+		std::copy(spans[0], spans[0] + spanLengths[0], destination);
+		return;
+	}
+	if(numSpans == 2){
+		mergeTwo(spans[0], spanLengths[0], spans[1], spanLengths[1], destination);
+		return;
+	}
+
+	long* heads = new long[numSpans];
+	long* position = new long[numSpans]();
+	for(int i = 0;i < numSpans;++i){
+		heads[i] = (spanLengths[i] > 0) ? spans[i][0] : LoserTree::exhausted;
+	}
+	LoserTree tree(heads, numSpans);
+
+	while(!tree.empty()){
+		int source = tree.winner();
+		*destination++ = tree.winnerValue();
+		long next = ++position[source];
+		tree.replaceWinner((next < spanLengths[source]) ? spans[source][next] : LoserTree::exhausted);
+	}
+
+	delete[] heads;
+	delete[] position;
+}
+
+
+void mergeParts(int* array, const long* partStart, int numParts, int* buffer){
+	if(numParts <= 1)
+		return;
+
+	//merge pairs of parts back and forth between array and buffer
+	int* source = array;
+	int* destination = buffer;
+	for(int width = 1;width < numParts;width *= 2){
+		for(int i = 0;i < numParts;i += 2 * width){
+			long start = partStart[i];
+			long middle = partStart[std::min(i + width, numParts)];
+			long end = partStart[std::min(i + 2 * width, numParts)];
+			mergeTwo(source + start, middle - start, source + middle, end - middle, destination + start);
+		}
+		std::swap(source, destination);
+	}
+	if(source != array){
+		std::copy(source + partStart[0], source + partStart[numParts], array + partStart[0]);
+	}
+}
+
+
+/****************************************************************
+PARALLEL MERGE***************************************************
+*****************************************************************
+-A pass of parallelMergeParts gives each thread an equal share of the values the pass writes, wherever the pairs of parts begin and end, so a
+	thread can merge the end of one pair and the start of the next. Where a thread's share begins within a pair's output is found by its merge
+	path: the merged output's first d values are the first i of one part and the first d - i of the other, for the i found by a binary search
+	along the diagonal of length d. Each thread merges from the split at the start of its share to the split at its end, so the threads write
+	disjoint ranges without waiting on each other, and the pass ends when they all have.
+*****************************************************************/
+
+
+//Find where the first diagonal values of the merge of two sorted arrays come from: the first firstSplit values of first and the first 
+	//diagonal - firstSplit of second. Ties are taken from first, like mergeTwo
+inline void mergePathSplit(const int* first, long firstLength, const int* second, long secondLength, long diagonal, long& firstSplit){
+	long low = std::max(0l, diagonal - secondLength);
+	long high = std::min(diagonal, firstLength);
+	while(low < high){
+		long middle = (low + high) / 2;
+		if(first[middle] <= second[diagonal - middle - 1])
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	firstSplit = low;
+}
+
+
+void parallelMergeParts(int* array, const long* partStart, int numParts, int* buffer, int numThreads){
+	if(numParts <= 1)
+		return;
+	if(numThreads <= 1){
+		mergeParts(array, partStart, numParts, buffer);
+		return;
+	}
+
+	long start = partStart[0];
+	long length = partStart[numParts] - start;
+	int* source = array;
+	int* destination = buffer;
+	for(int width = 1;width < numParts;width *= 2){
+		std::vector<std::thread> threads;
+		for(int t = 0;t < numThreads;++t){
+			threads.emplace_back([=](){
+				long shareStart = start + (long)t * length / numThreads;
+				long shareEnd = start + (long)(t + 1) * length / numThreads;
+				for(int i = 0;i < numParts;i += 2 * width){
+					long pairStart = partStart[i];
+					long middle = partStart[std::min(i + width, numParts)];
+					long pairEnd = partStart[std::min(i + 2 * width, numParts)];
+					long outputStart = std::max(shareStart, pairStart);
+					long outputEnd = std::min(shareEnd, pairEnd);
+					if(outputStart >= outputEnd)
+						continue;
+
+					const int* first = source + pairStart;
+					const int* second = source + middle;
+					long firstLength = middle - pairStart;
+					long secondLength = pairEnd - middle;
+					long firstStart, firstEnd;
+					mergePathSplit(first, firstLength, second, secondLength, outputStart - pairStart, firstStart);
+					mergePathSplit(first, firstLength, second, secondLength, outputEnd - pairStart, firstEnd);
+					long secondStart = outputStart - pairStart - firstStart;
+					long secondEnd = outputEnd - pairStart - firstEnd;
+					mergeTwo(first + firstStart, firstEnd - firstStart, second + secondStart, secondEnd - secondStart, destination + outputStart);
+				}
+			});
+		}
+		for(std::thread& thread : threads){
+			thread.join();
+		}
+		std::swap(source, destination);
+	}
+
+	//after an odd number of passes the values are in buffer
+	if(source != array){
+		std::vector<std::thread> threads;
+		for(int t = 0;t < numThreads;++t){
+			threads.emplace_back([=](){
+				long shareStart = start + (long)t * length / numThreads;
+				long shareEnd = start + (long)(t + 1) * length / numThreads;
+				std::copy(source + shareStart, source + shareEnd, array + shareStart);
+			});
+		}
+		for(std::thread& thread : threads){
+			thread.join();
+		}
+	}
+}
@@ -0,0 +1,58 @@
+
+#ifndef k_way_merge
+#define k_way_merge
+
+#include <climits>	//LONG_MAX
+
+
+//Merge two sorted arrays into destination, which must not overlap them. Compiled with AVX2, 8 values are merged at a time with a bitonic merge
+void mergeTwo(const int* first, long firstLength, const int* second, long secondLength, int* destination);
+//Merge numSpans sorted arrays into destination, which must not overlap them, with a LoserTree. The spans can come from any of the sorts
+	//(pyramidSort, treeSort, quickSort...)
+void mergeSpans(const int* const* spans, const long* spanLengths, int numSpans, int* destination);
+//Merge the sorted parts of array, part i from partStart[i] up to partStart[i + 1], so that array is sorted. buffer holds as many values as array.
+	//Pairs of parts are merged with mergeTwo, back and forth between array and buffer
+void mergeParts(int* array, const long* partStart, int numParts, int* buffer);
+//mergeParts with numThreads threads, each merging an equal share of the values of each pass
+void parallelMergeParts(int* array, const long* partStart, int numParts, int* buffer, int numThreads);
+
+
+//Tournament tree over sorted sources, each node above the leaves holding the key of the source that lost the match there, the winner going on up.
+	//A key is a source's next value with the source's number below it, so that one comparison decides a match and ties go to the lower source.
+	//Replacing the winner replays its matches on the way up, swapping keys with a mask at each level rather than branching on the values
+class LoserTree {
+	public:
+	static const long exhausted = LONG_MAX;	//The head of a source with no values left, losing to every value
+
+	LoserTree(const long* heads, int numSources);	//The first value of each source, or exhausted
+	~LoserTree();
+	LoserTree(const LoserTree&) = delete;
+	LoserTree& operator=(const LoserTree&) = delete;
+
+	bool empty() const { return losers[0] == exhausted; }	//Every source is exhausted
+	int winner() const { return (int)(losers[0] & sourceMask); }	//The source of the lowest head. The tree must not be empty
+	int winnerValue() const { return (int)(losers[0] >> 32); }	//The lowest head. The tree must not be empty
+
+	//Replace the winner's head with the next value of its source, or exhausted
+	void replaceWinner(long head){
+		int source = winner();
+		long key = (head == exhausted) ? exhausted : makeKey(head, source);
+		for(int node = (numLeaves + source) / 2;node >= 1;node /= 2){
+			long loser = losers[node];
+			long swapped = (loser ^ key) & -(long)(loser < key);	//a mask rather than a min and a max, which compilers turn into a branch
+			losers[node] = loser ^ swapped;
+			key ^= swapped;
+		}
+		losers[0] = key;
+	}
+
+	private:
+	static const long sourceMask = 0xffffffffl;
+
+	long* losers;	//losers[0] is the winner
+	int numLeaves;	//The number of sources up to a power of 2, the leaves past the sources exhausted
+
+	static long makeKey(long value, int source){ return (long)((unsigned long)value << 32) | source; }
+};
+
+#endif
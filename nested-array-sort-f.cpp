@@ -1,6 +1,8 @@
 //Nested array sort with fixed sized arrays
 
-#include <cstring> //memmove
+#include <cstring> //memmove, memcpy
+#include <algorithm>	//min
+#include <new>	//align_val_t
 
 //#define DIAGNOSTICS
 #ifdef DIAGNOSTICS
@@ -42,6 +44,14 @@ minuscule amount of cases, but reduces memory consumption from an absurd amount
 elements in the middle of an array end up farther apart than ones nearer the edge, because the algorithm forbids moving elements near the center to insert
 elements between. Ideally, nested arrays would contain an equal amount of elements, and this becomes a mitigating advantage for the performance of this 
 alternative compared to the original.
+-Memory comes from a ContainerPool rather than being carved out of one large block reserved for the worst case. Most containers are on the bottom nest 
+levels and hold only a few elements, so a container gets an array of one cache line at first, and moves to an 
+array twice as long when the side its elements have to move to reaches the end of a more than half full array, up to the largest array any container 
+needs. The array it leaves goes back to the pool for the next container that needs one of its size. A less than half full array has its elements moved 
+back to the middle instead. Containers are kept apart from their arrays, so a container moving to a bigger array stays where it is and the element that 
+points to it doesn't change.
+-A pool can be given a limit on the memory it allocates, and a sort that would need more than that gives its containers back and leaves the array as it was.
+-Elements that fall before the first element of a full array go in the array's own nested array, like in pyramid sort.
 *****************************************************************/
 
 
@@ -52,20 +62,19 @@ alternative compared to the original.
 //	will be searching through more elements in higher parent array rather than searching through many small nested arrays.)
 //Move binary search to its own function
 
-#include "nested-array-sort.h"
+#include "nested-array-sort-f.h"
 
 int maxArraySize();
 
-int numElements;//Keep track of how much memory is used
-int numContainers;//Keep track of the total amount of arrays
-
 
 //elementContainer data struct contains values of beginning index and ending index, and an array for all the elements it contains
 struct elementContainer{
 	element *array;
+	elementContainer *nestedContainer;	//Holds the elements that fall before the first element (nullptr if there are none)
 	int firstElementIndex;
 	int lastElementIndex;
 	int numElements;
+	int sizeClass;	//The size of array, see ContainerPool::arrayLength
 };
 
 
@@ -82,11 +91,189 @@ int maxArraySize(){
 }
 
 
-//Insert an element into the elementContainer
-void insertElement(int value,elementContainer* destination,const int &remainingUnsortedElements,elementContainer* const allContainers, element* const allElements){
+//Containers allocated for the sort of an array of arrayLength elements by allocateMemory, each with an array of the smallest size, before the pool 
+	//has to allocate more. With random data there is about 1 container for every 6-7 elements
+int seedContainers(int arrayLength){
+	return 2 + arrayLength / 5;
+}
+
+
+int ContainerPool::arrayLength(int sizeClass){
+	//Up to room for a full array plus one free element on each side, rounded up to whole cache lines
+	const int elementsPerLine = 64 / sizeof(element);
+	int largestLength = (maxArraySize() + 3 + elementsPerLine - 1) / elementsPerLine * elementsPerLine;
+	return std::min(elementsPerLine << sizeClass, largestLength);
+}
+
+int ContainerPool::numSizeClasses(){
+	int sizeClass = 0;
+	while(arrayLength(sizeClass) < arrayLength(sizeClass + 1))
+		++sizeClass;
+	return sizeClass + 1;
+}
+
+
+ContainerPool::ContainerPool(long maxBytes){
+	freeContainers = nullptr;
+	for(int i = 0;i < maxSizeClasses;++i){
+		freeArrays[i] = nullptr;
+	}
+	numContainersInUse = 0;
+	usedBytes = 0;
+	byteLimit = maxBytes;
+	
+	slabsLength = 16;
+	slabs = new char*[slabsLength];
+	numSlabs = 0;
+	slabsBytes = 0;
+	slabTop = nullptr;
+	slabSpace = 0;
+}
+
+ContainerPool::~ContainerPool(){
+	for(int i = 0;i < numSlabs;++i){
+		::operator delete(slabs[i], std::align_val_t(64));
+	}
+	delete[] slabs;
+}
+
+
+//Start a new slab of at least minBytes, as big as a slab can be or as what is left of the limit. False if that is less than minBytes. What was left
+	//of the last slab is too small for what is being cut, and goes unused
+bool ContainerPool::addSlab(long minBytes){
+	long length = slabBytes;
+	if(byteLimit > 0)
+		length = std::min(length, (byteLimit - slabsBytes) / lineBytes * lineBytes);
+	if(length < minBytes)
+		return false;
+	
+	if(numSlabs == slabsLength){
+		char** grownSlabs = new char*[2 * slabsLength];
+		memcpy(grownSlabs, slabs, sizeof(char*) * numSlabs);
+		delete[] slabs;
+		slabs = grownSlabs;
+		slabsLength *= 2;
+	}
+	
+	slabTop = static_cast<char*>(::operator new(length, std::align_val_t(lineBytes)));
+	slabs[numSlabs++] = slabTop;
+	slabsBytes += length;
+	slabSpace = length;
+	return true;
+}
+
+//Cut a whole number of cache lines from the last slab, or nullptr if a new slab is needed and the pool is at its limit
+char* ContainerPool::cut(long bytes){
+	if(slabSpace < bytes && !addSlab(bytes))
+		return nullptr;
+	
+	char* memory = slabTop;
+	slabTop += bytes;
+	slabSpace -= bytes;
+	return memory;
+}
+
+//Cut a cache line of free containers
+bool ContainerPool::addContainers(){
+	elementContainer* containers = reinterpret_cast<elementContainer*>(cut(lineBytes));
+	if(containers == nullptr)
+		return false;
+	
+	for(int i = lineBytes / sizeof(elementContainer) - 1;i >= 0;--i){
+		containers[i].nestedContainer = freeContainers;
+		freeContainers = containers + i;
+	}
+	return true;
+}
+
+//Cut a free array of a size
+bool ContainerPool::addArray(int sizeClass){
+	element* array = reinterpret_cast<element*>(cut(sizeof(element) * arrayLength(sizeClass)));
+	if(array == nullptr)
+		return false;
+	
+	giveArray(array, sizeClass);
+	return true;
+}
+
+element* ContainerPool::takeArray(int sizeClass){
+	if(freeArrays[sizeClass] == nullptr && !addArray(sizeClass))
+		return nullptr;
+	
+	element* array = freeArrays[sizeClass];
+	freeArrays[sizeClass] = reinterpret_cast<element*>(array[0].nestedContainer);
+	usedBytes += sizeof(element) * arrayLength(sizeClass);
+	return array;
+}
+
+void ContainerPool::giveArray(element* array, int sizeClass){
+	array[0].nestedContainer = reinterpret_cast<elementContainer*>(freeArrays[sizeClass]);
+	freeArrays[sizeClass] = array;
+}
+
+void ContainerPool::seed(elementContainer* containers, int numContainers, element* elements, long numElements){
+	for(int i = numContainers - 1;i >= 0;--i){
+		containers[i].nestedContainer = freeContainers;
+		freeContainers = containers + i;
+	}
+	for(long i = numElements / arrayLength(0) - 1;i >= 0;--i){
+		giveArray(elements + i * arrayLength(0), 0);
+	}
+}
+
+
+elementContainer* ContainerPool::acquire(){
+	if(freeContainers == nullptr && !addContainers())
+		return nullptr;
+	element* array = takeArray(0);
+	if(array == nullptr)
+		return nullptr;
+	
+	elementContainer* container = freeContainers;
+	freeContainers = container->nestedContainer;
+	++numContainersInUse;
+	usedBytes += sizeof(elementContainer);
+	
+	container->array = array;
+	container->sizeClass = 0;
+	container->nestedContainer = nullptr;
+	container->firstElementIndex = arrayLength(0) / 2;
+	container->lastElementIndex = container->firstElementIndex - 1;
+	container->numElements = 0;
+	return container;
+}
+
+bool ContainerPool::grow(elementContainer* container){
+	element* array = takeArray(container->sizeClass + 1);
+	if(array == nullptr)
+		return false;
+	
+	int newFirstIndex = (arrayLength(container->sizeClass + 1) - container->numElements) / 2;
+	memcpy(array + newFirstIndex, container->array + container->firstElementIndex, sizeof(element) * container->numElements);
+	giveArray(container->array, container->sizeClass);
+	usedBytes -= sizeof(element) * arrayLength(container->sizeClass);
+	
+	container->array = array;
+	++container->sizeClass;
+	container->lastElementIndex += newFirstIndex - container->firstElementIndex;
+	container->firstElementIndex = newFirstIndex;
+	return true;
+}
+
+void ContainerPool::release(elementContainer* container){
+	giveArray(container->array, container->sizeClass);
+	usedBytes -= sizeof(element) * arrayLength(container->sizeClass) + sizeof(elementContainer);
+	container->nestedContainer = freeContainers;
+	freeContainers = container;
+	--numContainersInUse;
+}
+
+
+//Insert an element into the elementContainer. Returns false if it needs a container or a bigger array and the pool is at its limit
+bool insertElement(int value,elementContainer* destination,ContainerPool& pool){
 	
 	bool isHigherThanMedian;
-	int valuePosition; //The index of the greatest value less than or equal to the value to be inserted
+	int valuePosition; //The index of the greatest value less than or equal to the value to be inserted, firstElementIndex - 1 if there is none
 	int low;
 	int high;
 	int mid;
@@ -97,21 +284,9 @@ void insertElement(int value,elementContainer* destination,const int &remainingU
 	
 	low = destination->firstElementIndex;
 	high = destination->lastElementIndex;
-	mid = (low+high) / 2;
-	
-	//Check to see if the value to insert is higher or lower than the median, while updating low / high value for binary search
-	if(value >= destination->array[mid].val){
-		isHigherThanMedian = true;
-		low = mid + 1;
-	}
-	else{
-		isHigherThanMedian = false;
-		high = mid - 1;
-	}
-	
 	
-	//binary search
-	while(low < high){
+	//binary search, ending with high at the greatest value less than or equal to the value to be inserted
+	while(low <= high){
 		mid = (low + high) / 2;
 		
 		if(value >= destination->array[mid].val)
@@ -119,19 +294,33 @@ void insertElement(int value,elementContainer* destination,const int &remainingU
 		else
 			high = mid - 1;
 	}
+	valuePosition = high;
 	
-	
-	//use high to compare and assign, (either low or high work, but consistency is needed)
-	//This index is either the valuePosition or 1 higher than the valuePosition
-	if(value >= destination->array[high].val)
-		valuePosition = high;
-	else
-		valuePosition = high - 1;
+	//Check to see if the value to insert is higher or lower than the median
+	isHigherThanMedian = (valuePosition >= (destination->firstElementIndex + destination->lastElementIndex) / 2);
 	
 		//if the array is small enough, move the elements in the array to insert the element.
 		//else insert the element into a nested array
 		if(destination->numElements <= maxArraySize()){
 			
+			//if the side that has to move is at the end of the array, move the elements to the middle of the next size of array if it is more
+				//than half full, or else back to the middle of the array
+			int length = ContainerPool::arrayLength(destination->sizeClass);
+			if((isHigherThanMedian && destination->lastElementIndex == length - 1) || (!isHigherThanMedian && destination->firstElementIndex == 0)){
+				int oldFirstIndex = destination->firstElementIndex;
+				if(2 * destination->numElements > length && destination->sizeClass + 1 < ContainerPool::numSizeClasses()){
+					if(!pool.grow(destination))
+						return false;
+				}
+				else{
+					int newFirstIndex = (length - destination->numElements) / 2;
+					memmove(destination->array + newFirstIndex, destination->array + oldFirstIndex, sizeof(element) * destination->numElements);
+					destination->lastElementIndex += newFirstIndex - oldFirstIndex;
+					destination->firstElementIndex = newFirstIndex;
+				}
+				valuePosition += destination->firstElementIndex - oldFirstIndex;
+			}
+			
 			//if the value to be inserted is higher than the median then inserting it would move all elements greater than it 1 index higher.
 			//The opposite is done if the value is lower than the median (all elements less than or equal to the value to be inserted are moved an index lower)
 			if(isHigherThanMedian){
@@ -143,7 +332,7 @@ void insertElement(int value,elementContainer* destination,const int &remainingU
 				destination->array[valuePosition + 1].nestedContainer = nullptr;
 				++destination->lastElementIndex;
 				++destination->numElements;
-				return;
+				return true;
 			}
 			
 			else{
@@ -154,31 +343,20 @@ void insertElement(int value,elementContainer* destination,const int &remainingU
 				destination->array[valuePosition].nestedContainer = nullptr;
 				--destination->firstElementIndex;
 				++destination->numElements;
-				return;
+				return true;
 			}
 		}
 		else{
-			//if a nested array already exists
-			if(destination->array[valuePosition].nestedContainer != nullptr){
-				destination = destination->array[valuePosition].nestedContainer;
-				continue;
-			}
-			//else create a nested array and assign it memory
-			else{
-				destination->array[valuePosition].nestedContainer = allContainers + numContainers;
-				++numContainers;
-				
-				destination->array[valuePosition].nestedContainer->array = allElements + numElements;
-				numElements += 2 * maxArraySize();
-				destination->array[valuePosition].nestedContainer->firstElementIndex = maxArraySize();
-				destination->array[valuePosition].nestedContainer->lastElementIndex = destination->array[valuePosition].nestedContainer->firstElementIndex;
-				destination->array[valuePosition].nestedContainer->array[destination->array[valuePosition].nestedContainer->firstElementIndex].val = value;
-				destination->array[valuePosition].nestedContainer->array[destination->array[valuePosition].nestedContainer->firstElementIndex].nestedContainer = nullptr;
-				destination->array[valuePosition].nestedContainer->numElements = 1;
-				
-				return;
-				
-			}
+			//the nested array is the one associated with the element at valuePosition, or the container's own if the value is before the first element
+			elementContainer*& nestedContainer = (valuePosition < destination->firstElementIndex) ? 
+				destination->nestedContainer : destination->array[valuePosition].nestedContainer;
+			
+			//if a nested array doesn't exist yet, take one from the pool
+			if(nestedContainer == nullptr)
+				nestedContainer = pool.acquire();
+			if(nestedContainer == nullptr)
+				return false;
+			destination = nestedContainer;
 		}
 
 
@@ -186,83 +364,106 @@ void insertElement(int value,elementContainer* destination,const int &remainingU
 }
 
 
-//Class to extract the elements from their nested elementContainers and put them in the correct, sorted order into a standard array
+//Class to extract the elements from their nested elementContainers and put them in the correct, sorted order into a standard array.
+//Containers are given back to the pool once their elements have been placed
 class ElementToArrayPlacer {
 	static int index;
-	static void place(elementContainer *source, int *array){
+	static void place(elementContainer *source, int *array, ContainerPool& pool){
+		if(source->nestedContainer != nullptr){
+			place(source->nestedContainer, array, pool);
+		}
 		for(int i = source->firstElementIndex; i <= source->lastElementIndex; ++i){
 			array[index] = source->array[i].val;
 			++index;
 			if(source->array[i].nestedContainer != nullptr){
-				place(source->array[i].nestedContainer, array);
+				place(source->array[i].nestedContainer, array, pool);
 			}
 		}
+		pool.release(source);
 	}
 	
 	public:
-	static void placeElementsInArray(elementContainer *source, int *array){
+	static void placeElementsInArray(elementContainer *source, int *array, ContainerPool& pool){
 		index = 0;
-		place(source, array);
+		place(source, array, pool);
 	}
 };
 int ElementToArrayPlacer::index;
 
 
-//Allocates memory for allContainers and allElements based on the array length
+//Give a container and its nested containers back to the pool without placing their elements
+void releaseContainers(elementContainer *source, ContainerPool& pool){
+	if(source->nestedContainer != nullptr){
+		releaseContainers(source->nestedContainer, pool);
+	}
+	for(int i = source->firstElementIndex; i <= source->lastElementIndex; ++i){
+		if(source->array[i].nestedContainer != nullptr){
+			releaseContainers(source->array[i].nestedContainer, pool);
+		}
+	}
+	pool.release(source);
+}
+
+
+//Allocates memory for allContainers and allElements based on the array length. This is the pool's first seedContainers(arrayLength) containers with
+	//arrays of the smallest size, more are allocated during the sort if needed
 void allocateMemory(int arrayLength, elementContainer*& allContainers, element*& allElements){
-	allContainers = new elementContainer[10000];
-	allElements = new element[2'000'000];
+	int numContainers = seedContainers(arrayLength);
+	allContainers = new elementContainer[numContainers];
+	allElements = static_cast<element*>(::operator new(sizeof(element) * (long)numContainers * ContainerPool::arrayLength(0), std::align_val_t(64)));
 }
 //Deallocates memory for allContainers and allElements
 void deallocateMemory(elementContainer*& allContainers, element*& allElements){
 	delete[] allContainers;
-	delete[] allElements;
+	::operator delete(allElements, std::align_val_t(64));
 	allContainers = nullptr;
 	allElements = nullptr;
 }
 
 
+//The pool allocates as it goes, rather than starting from allocateMemory's containers, which only have arrays of the smallest size
 void nestedArraySort(int* array, int arrayLength){
-	elementContainer* allContainers = nullptr;
-	element* allElements = nullptr;
-	allocateMemory(arrayLength,allContainers,allElements);
-	nestedArraySort(array, arrayLength, allContainers, allElements);
-	deallocateMemory(allContainers,allElements);
+	ContainerPool pool;
+	nestedArraySort(array, arrayLength, pool);
 }
 
 
 void nestedArraySort(int *array, int arrayLength, elementContainer* const allContainers, element* const allElements){
+	ContainerPool pool;
+	int numContainers = seedContainers(arrayLength);
+	pool.seed(allContainers, numContainers, allElements, (long)numContainers * ContainerPool::arrayLength(0));
+	nestedArraySort(array, arrayLength, pool);
+}
+
+
+bool nestedArraySort(int *array, int arrayLength, ContainerPool& pool){
 	if(arrayLength <= 1)
-		return;
-	int numElements = 0;
-	int numContainers = 0;
-	//Assign parent elementContainer
-	elementContainer *parent = allContainers;
-	++numContainers;
+		return true;
+	
+	//Assign parent elementContainer. Like every other container, it starts in the middle of its array
+	elementContainer *parent = pool.acquire();
+	if(parent == nullptr)
+		return false;
 	
-	//Assign the parent elementContainer's array
-	parent->array = allElements; //2 times the maximum array length, because the starting element is in the middle, and hypothetically the length of the array can span n elements to the end (each element higher than the previous) or n elements to the beginning (each element lower than the previous)
-	numElements += 2*maxArraySize();	//Subsequent arrays will be assigned at allElements[numElements] so that two arrays never overlap
 	//Add the initial element
-	parent->firstElementIndex = arrayLength;	//halfway between the beginning and end of parent->array
-	parent->lastElementIndex = parent->firstElementIndex;
+	++parent->lastElementIndex;
 	parent->numElements = 1;
 	parent->array[parent->firstElementIndex].val = array[0];
 	parent->array[parent->firstElementIndex].nestedContainer = nullptr;
 	
 	//For each element
-	int remainingUnsortedElements = arrayLength - 1;	//Number of elements minus the initial element
 	for(int i = 1;i < arrayLength;++i){
-		insertElement(array[i],parent,remainingUnsortedElements,allContainers,allElements);
-		--remainingUnsortedElements;
+		if(!insertElement(array[i],parent,pool)){
+			releaseContainers(parent, pool);
+			return false;
+		}
 	}
 	
-	ElementToArrayPlacer::placeElementsInArray(parent, array);
-	
 	#ifdef DIAGNOSTICS
-	std::cout << "Number of elements in memory: " << numElements << "\n";
-	std::cout << "Number of elementContainers in memory: " << numContainers << "\n";
-	std::cout << "Size of elementContainer: " << sizeof(elementContainer) << ", size of element: " << sizeof(element) << "\nFor a total memory usage of: " << 
-	sizeof(elementContainer) * numContainers + sizeof(element) * numElements << "\n";
+	std::cout << "Number of elementContainers in memory: " << pool.containersInUse() << "\n";
+	std::cout << "Memory used by containers and their arrays: " << pool.bytesInUse() << "\n";
 	#endif
-}
\ No newline at end of file
+	
+	ElementToArrayPlacer::placeElementsInArray(parent, array, pool);
+	return true;
+}
@@ -0,0 +1,74 @@
+#ifndef nested_array_sort_f
+#define nested_array_sort_f
+
+struct elementContainer; struct element;
+
+
+//Pool of containers and of arrays for them, in sizes from a cache line up to the largest array a container can need. A container starts with the
+	//smallest array and moves to the next size when it fills up, giving the smaller array back, so the memory in use follows the number of elements
+	//rather than the number of containers. Memory is allocated a slab at a time, aligned to cache lines, and kept for reuse when containers are
+	//given back, so a pool can be kept (per tenant, for example) and reused across sorts. Containers and arrays of every size are cut from the same
+	//slabs as they are needed. With a limit, the last slab is cut down to what is left of it, so the pool allocates at most the limit and can use
+	//all of it (but for less than the largest array at the end of each slab), and acquire and grow fail instead of going over
+class ContainerPool {
+	public:
+	static const int maxSizeClasses = 8;
+
+	ContainerPool(long maxBytes = 0);	//0 for no limit on the memory the pool allocates
+	~ContainerPool();
+	ContainerPool(const ContainerPool&) = delete;
+	ContainerPool& operator=(const ContainerPool&) = delete;
+
+	void seed(elementContainer* containers, int numContainers, element* elements, long numElements);	//Add caller owned memory (from allocateMemory)
+	elementContainer* acquire();	//An empty container with the smallest array, or nullptr if the pool is at its limit
+	bool grow(elementContainer* container);	//Move the container's elements to the middle of the next size of array. False if the pool is at its limit
+	void release(elementContainer* container);	//Give back the container and its array
+
+	int containersInUse() const { return numContainersInUse; }
+	long bytesInUse() const { return usedBytes; }	//Containers and arrays in use
+	long reservedBytes() const { return slabsBytes; }	//Memory allocated by the pool itself, not counting seeded memory
+	long maxBytes() const { return byteLimit; }
+
+	static int arrayLength(int sizeClass);	//Elements in the arrays of a size, the largest holding a full array plus one free element on each side
+	static int numSizeClasses();
+
+	private:
+	static const long slabBytes = 1 << 16;	//The most memory a slab takes
+	static const long lineBytes = 64;	//Everything is cut from slabs in whole cache lines
+
+	elementContainer* freeContainers;	//Linked through their nestedContainer
+	element* freeArrays[maxSizeClasses];	//For each size, linked through the first element's nestedContainer
+	int numContainersInUse;
+	long usedBytes;
+	long byteLimit;
+
+	char** slabs;
+	int numSlabs;
+	int slabsLength;
+	long slabsBytes;
+	char* slabTop;	//Where the next cut from the last slab starts
+	long slabSpace;	//Bytes left to cut from the last slab
+
+	char* cut(long bytes);
+	bool addSlab(long minBytes);
+	bool addContainers();
+	bool addArray(int sizeClass);
+	element* takeArray(int sizeClass);
+	void giveArray(element* array, int sizeClass);
+};
+
+
+//Perform fixed size nestedArraySort with internal allocation/deallocation of memory
+void nestedArraySort(int *array, int arrayLength);
+//Perform fixed size nestedArraySort with external allocation/deallocation of memory. The pool adds to it if it runs out
+void nestedArraySort(int *array, int arrayLength, elementContainer* const allContainers, element* const allElements);
+//Perform fixed size nestedArraySort using containers from pool, which are given back to it once the sorted elements have been placed in array.
+	//Returns false, with array left as it was, if the pool reaches its limit
+bool nestedArraySort(int *array, int arrayLength, ContainerPool& pool);
+
+//Allocates memory for allContainers and allElements based on the array length
+void allocateMemory(int arrayLength, elementContainer*& allContainers, element*& allElements);
+//Deallocates memory for allContainers and allElements
+void deallocateMemory(elementContainer*& allContainers, element*& allElements);
+
+#endif
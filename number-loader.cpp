@@ -0,0 +1,444 @@
+//Number loader
+
+#include <cstring>	//memcpy, memchr
+#include <algorithm>	//max
+#include <thread>
+#include <vector>
+#include <fcntl.h>	//open
+#include <sys/mman.h>	//mmap
+#include <sys/stat.h>	//fstat
+#include <unistd.h>	//close
+#include "number-loader.h"
+
+
+/****************************************************************
+NUMBER LOADER****************************************************
+*****************************************************************
+-The sample files are a decimal integer on each line, and parsing them with iostreams takes longer than sorting them. The loader maps the file 
+	into memory instead of reading it, and parses it in place 8 bytes at a time (SWAR: SIMD within a register, with 64 bit integer operations).
+-A byte is a digit when it is from '0' to '9', which for 8 bytes at once is two subtractions: one sets the high bit of each byte from '0' up, 
+	the other of each byte above '9'. A number starts at a digit after a non-digit, so counting the numbers is a population count of the digits 
+	whose previous byte isn't one.
+-Up to 8 digits are turned into their value with 3 multiplications: each pair of digits is combined into a byte, each pair of those into 16 bits, 
+	and those into the value. Longer numbers (up to the 10 digits of an int) add the remaining digits one at a time.
+-Threads take parts of the file split at newlines. Each counts the numbers in its part first, so that each knows where in the array its numbers
+	go, then parses its part straight into the array.
+*****************************************************************/
+
+
+const unsigned long eachByte = 0x0101010101010101ul;	//Multiplying a byte by this repeats it in each byte of a word
+const unsigned long highBits = 0x8080808080808080ul;
+
+
+//The high bit of each byte in word that is a digit
+inline unsigned long digitBits(unsigned long word){
+	unsigned long fromZero = (word | highBits) - '0' * eachByte;	//high bit set when the byte (without its high bit) is at least '0'
+	unsigned long aboveNine = (word & ~highBits) + (0x7f - '9') * eachByte;	//high bit set when it is above '9'
+	return fromZero & ~aboveNine & ~word & highBits;
+}
+
+inline unsigned long loadWord(const char* bytes){
+	unsigned long word;
+	memcpy(&word, bytes, sizeof(word));
+	return word;
+}
+
+
+//Count the numbers in [start, end). The byte before start isn't a digit
+long countNumbersInPart(const char* start, const char* end){
+	long numNumbers = 0;
+	unsigned long previousDigits = 0;	//the digit bits of the last word, for whether the first byte of the next one continues a number
+	const char* position = start;
+	for(;position + sizeof(unsigned long) <= end;position += sizeof(unsigned long)){
+		unsigned long digits = digitBits(loadWord(position));
+		unsigned long numberStarts = digits & ~((digits << 8) | (previousDigits >> 56));
+		numNumbers += __builtin_popcountl(numberStarts);
+		previousDigits = digits;
+	}
+	
+	bool isPreviousDigit = previousDigits >> 63;
+	for(;position < end;++position){
+		bool isDigit = (unsigned char)(*position - '0') < 10;
+		numNumbers += isDigit && !isPreviousDigit;
+		isPreviousDigit = isDigit;
+	}
+	return numNumbers;
+}
+
+
+//The value of the numDigits (1 to 8) digits at the start of word
+inline unsigned int parseDigits(unsigned long word, int numDigits){
+	//the digits move to the top of the word, so the ones missing are leading zeros
+	unsigned long digits = (word - '0' * eachByte) << (8 * (8 - numDigits));
+	digits = (digits * 10 + (digits >> 8)) & 0x00ff00ff00ff00fful;
+	digits = (digits * 100 + (digits >> 16)) & 0x0000ffff0000fffful;
+	digits = (digits * 10000 + (digits >> 32)) & 0xfffffffful;
+	return (unsigned int)digits;
+}
+
+//Parse the numbers in [start, end) into array from index, writing none at or after arrayLength
+void parsePart(const char* fileStart, const char* start, const char* end, int* array, long index, long arrayLength){
+	const char* position = start;
+	while(position < end){
+		
+		//skip to the next digit, a word at a time where it can
+		unsigned long digits = 0;
+		while(position + sizeof(unsigned long) <= end && (digits = digitBits(loadWord(position))) == 0){
+			position += sizeof(unsigned long);
+		}
+		if(digits != 0){
+			position += __builtin_ctzl(digits) / 8;
+		}
+		else{
+			while(position < end && (unsigned char)(*position - '0') >= 10){
+				++position;
+			}
+			if(position == end)
+				return;
+		}
+		bool isNegative = position > fileStart && position[-1] == '-';
+		
+		//the first 8 digits together when a whole word can be read, the rest one at a time
+		unsigned long value = 0;
+		if(position + sizeof(unsigned long) <= end){
+			unsigned long word = loadWord(position);
+			unsigned long nonDigits = ~digitBits(word) & highBits;
+			int numDigits = (nonDigits == 0) ? 8 : __builtin_ctzl(nonDigits) / 8;
+			value = parseDigits(word, numDigits);
+			position += numDigits;
+		}
+		while(position < end && (unsigned char)(*position - '0') < 10){
+			value = value * 10 + (*position - '0');
+			++position;
+		}
+		
+		if(index < arrayLength)
+			array[index] = isNegative ? (int)(0 - value) : (int)value;
+		++index;
+	}
+}
+
+
+//Map a file into memory for reading, returning nullptr and a length of -1 if it can't be read. An empty file is a nullptr of length 0
+const char* mapFile(const char* path, long& length){
+	length = -1;
+	int file = open(path, O_RDONLY);
+	if(file < 0)
+		return nullptr;
+	
+	struct stat fileStatus;
+	if(fstat(file, &fileStatus) != 0){
+		close(file);
+		return nullptr;
+	}
+	length = fileStatus.st_size;
+	if(length == 0){
+		close(file);
+		return nullptr;
+	}
+	
+	void* mapping = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, file, 0);
+	close(file);	//the mapping keeps the file open
+	if(mapping == MAP_FAILED){
+		length = -1;
+		return nullptr;
+	}
+	madvise(mapping, length, MADV_SEQUENTIAL);
+	return (const char*)mapping;
+}
+
+
+//Split [0, length) into numParts parts that start after a newline, writing numParts + 1 boundaries
+void splitAtNewlines(const char* file, long length, int numParts, long* partStart){
+	partStart[0] = 0;
+	for(int i = 1;i < numParts;++i){
+		long position = std::max(partStart[i - 1], length * i / numParts);
+		const char* newline = (position < length) ? (const char*)memchr(file + position, '\n', length - position) : nullptr;
+		partStart[i] = (newline != nullptr) ? newline - file + 1 : length;
+	}
+	partStart[numParts] = length;
+}
+
+
+long countNumbers(const char* path, int numThreads){
+	long length;
+	const char* file = mapFile(path, length);
+	if(file == nullptr)
+		return (length == 0) ? 0 : -1;
+	
+	long* partStart = new long[numThreads + 1];
+	long* partNumbers = new long[numThreads];
+	splitAtNewlines(file, length, numThreads, partStart);
+	
+	std::vector<std::thread> threads;
+	for(int t = 0;t < numThreads;++t){
+		threads.emplace_back([=](){
+			partNumbers[t] = countNumbersInPart(file + partStart[t], file + partStart[t + 1]);
+		});
+	}
+	long numNumbers = 0;
+	for(int t = 0;t < numThreads;++t){
+		threads[t].join();
+		numNumbers += partNumbers[t];
+	}
+	
+	munmap((void*)file, length);
+	delete[] partStart;
+	delete[] partNumbers;
+	return numNumbers;
+}
+
+long loadNumbers(const char* path, int* array, long arrayLength, int numThreads){
+	long length;
+	const char* file = mapFile(path, length);
+	if(file == nullptr)
+		return (length == 0) ? 0 : -1;
+	
+	long* partStart = new long[numThreads + 1];
+	long* partNumbers = new long[numThreads];
+	splitAtNewlines(file, length, numThreads, partStart);
+	
+	//each thread counts the numbers in its part, and once the counts give where in the array each part's numbers start, parses its part
+	std::vector<std::thread> threads;
+	std::vector<long> partIndex(numThreads + 1, 0);
+	for(int t = 0;t < numThreads;++t){
+		threads.emplace_back([=](){
+			partNumbers[t] = countNumbersInPart(file + partStart[t], file + partStart[t + 1]);
+		});
+	}
+	for(int t = 0;t < numThreads;++t){
+		threads[t].join();
+		partIndex[t + 1] = partIndex[t] + partNumbers[t];
+	}
+	
+	threads.clear();
+	for(int t = 0;t < numThreads;++t){
+		long index = partIndex[t];
+		threads.emplace_back([=](){
+			parsePart(file, file + partStart[t], file + partStart[t + 1], array, index, arrayLength);
+		});
+	}
+	for(std::thread& thread : threads){
+		thread.join();
+	}
+	
+	munmap((void*)file, length);
+	delete[] partStart;
+	delete[] partNumbers;
+	return partIndex[numThreads];
+}
+
+
+
+
+/****************************************************************
+NUMBER FILES*****************************************************
+*****************************************************************
+-Sorted output is written back through a buffer flushed a megabyte at a time. Text is formatted 8 digits at once, the inverse of parsing them: 
+	the value is split into two 4 digit halves in the two 32 bit halves of a word, each of those into 2 digit quarters, and each of those into 
+	bytes, with multiplications by reciprocals (x * 5243 >> 19 is x / 100 below 10000, x * 103 >> 10 is x / 10 below 100).
+-Binary numbers files skip parsing altogether. The header is 64 bytes so the values after it are aligned in the mapping. Flags say whether the 
+	values are sorted, found while writing them, and whether there is a checksum: Fletcher's, two running sums of the values, the second of 
+	which depends on their order.
+*****************************************************************/
+
+
+struct numbersFileHeader{
+	char magic[8];
+	unsigned int formatVersion;
+	unsigned int valueType;
+	long count;
+	unsigned int flags;
+	unsigned int headerLength;	//Bytes before the values
+	unsigned long checksum;
+	char padding[24];
+};
+static_assert(sizeof(numbersFileHeader) == numbersHeaderLength, "the values follow the header");
+
+const char numbersFileMagic[8] = {'N', 'U', 'M', 'B', 'E', 'R', 'S', '\n'};
+const unsigned int numbersFormatVersion = 1;
+const unsigned int int32Values = 0;
+const unsigned int sortedFlag = 1;
+const unsigned int checksumFlag = 2;
+const int writeBufferLength = 1 << 20;
+
+
+//The digits of a value below 10^8 in the bytes of a word, the highest first (in the lowest byte), with leading zeros
+inline unsigned long eightDigits(unsigned int value){
+	unsigned long digits = (value / 10000) | ((unsigned long)(value % 10000) << 32);
+	unsigned long hundreds = ((digits * 5243) >> 19) & 0x0000007f0000007ful;
+	digits = hundreds | ((digits - 100 * hundreds) << 16);
+	unsigned long tens = ((digits * 103) >> 10) & 0x000f000f000f000ful;
+	return tens | ((digits - 10 * tens) << 8);
+}
+
+//Write the decimal digits of value at text and return how many there are. Up to 10 bytes from text may be written
+inline int formatDigits(unsigned int value, char* text){
+	if(value >= 100000000){
+		unsigned int highDigits = value / 100000000;
+		int numHighDigits = (highDigits >= 10) ? 2 : 1;
+		text[0] = '0' + highDigits / 10;
+		text[numHighDigits - 1] = '0' + highDigits % 10;
+		unsigned long digits = eightDigits(value % 100000000) + '0' * eachByte;
+		memcpy(text + numHighDigits, &digits, sizeof(digits));
+		return numHighDigits + 8;
+	}
+	
+	unsigned long digits = eightDigits(value);
+	int leadingZeros = (value == 0) ? 7 : __builtin_ctzl(digits) / 8;
+	digits = (digits + '0' * eachByte) >> (8 * leadingZeros);
+	memcpy(text, &digits, sizeof(digits));
+	return 8 - leadingZeros;
+}
+
+
+//Write all of length bytes, returning false if they can't be
+bool writeAll(int file, const char* bytes, long length){
+	while(length > 0){
+		long written = write(file, bytes, length);
+		if(written <= 0)
+			return false;
+		bytes += written;
+		length -= written;
+	}
+	return true;
+}
+
+
+bool writeTextNumbers(const char* path, const int* array, long arrayLength){
+	int file = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if(file < 0)
+		return false;
+	
+	char* buffer = new char[writeBufferLength + 16];	//room past the end for a number's digits
+	long used = 0;
+	bool isWritten = true;
+	for(long i = 0;i < arrayLength && isWritten;++i){
+		unsigned int value = (unsigned int)array[i];
+		if(array[i] < 0){
+			buffer[used++] = '-';
+			value = 0 - value;
+		}
+		used += formatDigits(value, buffer + used);
+		buffer[used++] = '\n';
+		
+		if(used >= writeBufferLength){
+			isWritten = writeAll(file, buffer, used);
+			used = 0;
+		}
+	}
+	isWritten = isWritten && writeAll(file, buffer, used);
+	
+	delete[] buffer;
+	return (close(file) == 0) && isWritten;
+}
+
+
+//Fletcher's checksum with 64 bit sums
+void NumbersChecksum::add(const int* values, long length){
+	for(long i = 0;i < length;++i){
+		sum += (unsigned int)values[i];
+		sumOfSums += sum;
+	}
+}
+
+
+bool writeNumbersHeader(int file, long count, bool isSorted, const NumbersChecksum* checksum){
+	numbersFileHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, numbersFileMagic, sizeof(header.magic));
+	header.formatVersion = numbersFormatVersion;
+	header.valueType = int32Values;
+	header.count = count;
+	header.headerLength = sizeof(header);
+	header.flags = isSorted ? sortedFlag : 0;
+	if(checksum != nullptr){
+		header.flags |= checksumFlag;
+		header.checksum = checksum->value();
+	}
+	return pwrite(file, &header, sizeof(header), 0) == sizeof(header);
+}
+
+
+bool writeBinaryNumbers(const char* path, const int* array, long arrayLength, bool withChecksum){
+	bool isSorted = true;
+	for(long i = 1;i < arrayLength && isSorted;++i){
+		isSorted = array[i - 1] <= array[i];
+	}
+	NumbersChecksum checksum;
+	if(withChecksum)
+		checksum.add(array, arrayLength);
+	
+	int file = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if(file < 0)
+		return false;
+	bool isWritten = writeNumbersHeader(file, arrayLength, isSorted, withChecksum ? &checksum : nullptr) && 
+			lseek(file, numbersHeaderLength, SEEK_SET) == numbersHeaderLength && writeAll(file, (const char*)array, sizeof(int) * arrayLength);
+	return (close(file) == 0) && isWritten;
+}
+
+
+long convertTextToBinary(const char* textPath, const char* binaryPath, int numThreads){
+	long numNumbers = countNumbers(textPath, numThreads);
+	if(numNumbers < 0)
+		return -1;
+	
+	int* array = new int[numNumbers];
+	loadNumbers(textPath, array, numNumbers, numThreads);
+	bool isWritten = writeBinaryNumbers(binaryPath, array, numNumbers);
+	delete[] array;
+	return isWritten ? numNumbers : -1;
+}
+
+
+MappedNumbers::MappedNumbers(const char* path){
+	data = nullptr;
+	count = 0;
+	flags = 0;
+	checksum = 0;
+	mapping = mapFile(path, mappingLength);
+	if(mapping == nullptr)
+		return;
+	
+	numbersFileHeader header;
+	if(mappingLength < (long)sizeof(header))
+		return;
+	memcpy(&header, mapping, sizeof(header));
+	if(memcmp(header.magic, numbersFileMagic, sizeof(header.magic)) != 0 || header.formatVersion != numbersFormatVersion || 
+			header.valueType != int32Values || header.headerLength < sizeof(header) || header.headerLength % sizeof(int) != 0 || 
+			header.headerLength > mappingLength || header.count < 0 || (mappingLength - header.headerLength) / (long)sizeof(int) < header.count)
+		return;
+	
+	data = (const int*)(mapping + header.headerLength);
+	count = header.count;
+	flags = header.flags;
+	checksum = header.checksum;
+}
+
+MappedNumbers::~MappedNumbers(){
+	if(mapping != nullptr)
+		munmap((void*)mapping, mappingLength);
+}
+
+bool MappedNumbers::isSorted() const{
+	return flags & sortedFlag;
+}
+
+bool MappedNumbers::hasChecksum() const{
+	return flags & checksumFlag;
+}
+
+bool MappedNumbers::verifyChecksum() const{
+	NumbersChecksum valuesChecksum;
+	valuesChecksum.add(data, count);
+	return !hasChecksum() || valuesChecksum.value() == checksum;
+}
+
+
+long loadBinaryNumbers(const char* path, int* array, long arrayLength){
+	MappedNumbers numbers(path);
+	if(numbers.values() == nullptr)
+		return -1;
+	memcpy(array, numbers.values(), sizeof(int) * std::min(arrayLength, numbers.size()));
+	return numbers.size();
+}
@@ -0,0 +1,62 @@
+
+#ifndef number_loader
+#define number_loader
+
+
+//Count the decimal integers in a file, to size the array for loadNumbers. Returns -1 if the file can't be read
+long countNumbers(const char* path, int numThreads = 1);
+//Parse the decimal integers in a file into array, up to arrayLength of them, with numThreads threads. The numbers are separated by anything other 
+	//than a digit (newlines, and commas in some of the sample files), and negative when a '-' comes right before them. Returns how many numbers the 
+	//file holds, which is more than were written when arrayLength is too short, or -1 if the file can't be read
+long loadNumbers(const char* path, int* array, long arrayLength, int numThreads = 1);
+//Write the numbers as decimal text, one on each line. Returns false if the file can't be written
+bool writeTextNumbers(const char* path, const int* array, long arrayLength);
+
+
+//Binary numbers files hold a 64 byte header (the count, the type of the values, whether they are sorted and an optional checksum) followed by the
+	//values as they are in memory, so reading one is mapping it
+const int numbersHeaderLength = 64;	//Bytes before the values
+
+//Fletcher's checksum of the values in a binary numbers file, added to a block of values at a time
+struct NumbersChecksum {
+	unsigned long sum = 0;
+	unsigned long sumOfSums = 0;
+
+	void add(const int* values, long length);
+	unsigned long value() const { return sum ^ (sumOfSums << 32 | sumOfSums >> 32); }
+};
+
+//Write the header of a binary numbers file at the start of an open file, whose values are written after it separately. Without a checksum, 
+	//checksum is nullptr
+bool writeNumbersHeader(int file, long count, bool isSorted, const NumbersChecksum* checksum);
+//Write a binary numbers file. Returns false if the file can't be written
+bool writeBinaryNumbers(const char* path, const int* array, long arrayLength, bool withChecksum = true);
+//Convert a text file of numbers to a binary numbers file. Returns how many numbers there are, or -1 if either file can't be used
+long convertTextToBinary(const char* textPath, const char* binaryPath, int numThreads = 1);
+//Copy the values of a binary numbers file into array, up to arrayLength of them. Returns how many the file holds, or -1 if it can't be read
+long loadBinaryNumbers(const char* path, int* array, long arrayLength);
+
+//A binary numbers file mapped into memory, read in place
+class MappedNumbers {
+	public:
+	MappedNumbers(const char* path);	//values() is nullptr when the file can't be read or isn't a binary numbers file
+	~MappedNumbers();
+	MappedNumbers(const MappedNumbers&) = delete;
+	MappedNumbers& operator=(const MappedNumbers&) = delete;
+
+	const int* values() const { return data; }
+	long size() const { return count; }
+	bool isSorted() const;
+	bool hasChecksum() const;
+	bool verifyChecksum() const;	//Whether the values match the checksum, or true when there is none
+
+	private:
+	const char* mapping;
+	long mappingLength;
+	const int* data;
+	long count;
+	unsigned int flags;
+	unsigned long checksum;
+};
+
+#endif
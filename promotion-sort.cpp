@@ -3,6 +3,12 @@
 #include <cstring>	//memmove
 #include <cmath>	
 
+//#define AUTO_TUNE
+#ifdef AUTO_TUNE
+#include <chrono>
+#include <unistd.h>	//sysconf
+#endif
+
 
 /****************************************************************
 PROMOTION SORT************************************************
@@ -39,14 +45,13 @@ USEFULNESS
 
 
 //TODO:
-//Find a way to calculate the optimal container sizes and max nest level for a given array length
 //Move binary search to its own function
 //Trigger promotion of an element when a container hits its end or 0 index, rather than when a container hits a certain capacity
 	//This would allow the removal of acceptableFirstIndex variable
 //Allow a max container size that isn't even
-//Create a new header to use in place of nested-array-sort.h, and change name of function from nestedArraySort
+//Change name of function from nestedArraySort
 
-#include "nested-array-sort.h"
+#include "promotion-sort.h"
 
 class Benchmarks;
 elementContainer* promote(elementContainer* parentContainer, const int& valuePosition, const int& insertedValue, const bool& isHigherThanMedian, 
@@ -56,6 +61,7 @@ elementContainer* promote(elementContainer* parentContainer, const int& valuePos
 
 struct elementContainer{
 	element *array;
+	elementContainer *nestedContainer;	//Holds the elements that fall before the first element (only used on the leftmost containers)
 	int firstElementIndex;
 	int lastElementIndex;
 	int nestLevel;
@@ -69,17 +75,191 @@ struct element{
 };
 
 
+//The least amount of nest levels below the parent container that keeps the parent container from running out of room.
+//Every promotion creates a container, and a container only gets promoted after halfMaxElements elements have been inserted into it, so a nest level
+	//has at most 1 + (elements on the nest level) / halfMaxElements containers. The elements on a nest level are the containers on the nest level below,
+	//and the parent container has room for 2 * halfMaxElements of them
+int minimumNestLevel(int arrayLength, int halfMaxElements){
+	int nestLevel = 1;
+	int containers = 1 + arrayLength / halfMaxElements;	//containers on the bottom nest level
+	while(containers > 2 * halfMaxElements){
+		containers = 1 + containers / halfMaxElements;
+		++nestLevel;
+	}
+	return nestLevel;
+}
+
+//The most containers a sort can use, following the same bound as minimumNestLevel
+int maxContainers(int arrayLength, int halfMaxElements, int maxNestLevel){
+	int total = 1;	//parent container
+	int containers = 1 + arrayLength / halfMaxElements;
+	for(int nestLevel = maxNestLevel;nestLevel > 0;--nestLevel){
+		total += containers;
+		containers = 1 + containers / halfMaxElements;
+	}
+	return total;
+}
+
+
+#ifdef AUTO_TUNE
+//Timings measured once per process, that container sizes are tuned against
+struct Calibration {
+	long l1CacheSize;
+	long l2CacheSize;
+	double searchStepTime;	//One step of a binary search on a container in the L1 cache
+	double moveElementTime;	//Moving one element with memmove
+	double missTime;	//A load from memory outside the L2 cache
+	
+	Calibration(){
+		typedef std::chrono::steady_clock clock;
+		volatile int sink = 0;
+		unsigned int seed = 1;
+		
+		l1CacheSize = sysconf(_SC_LEVEL1_DCACHE_SIZE);
+		l2CacheSize = sysconf(_SC_LEVEL2_CACHE_SIZE);
+		if(l1CacheSize <= 0)
+			l1CacheSize = 32768;
+		if(l2CacheSize <= 0)
+			l2CacheSize = 262144;
+		
+		//Binary searches on a container of 256 elements
+		const int searchLength = 256;
+		const int searches = 100000;
+		element* searchArray = new element[searchLength];
+		for(int i = 0;i < searchLength;++i){
+			searchArray[i].val = 2 * i;
+			searchArray[i].nestedContainer = nullptr;
+		}
+		
+		clock::time_point start = clock::now();
+		for(int i = 0;i < searches;++i){
+			seed = seed * 1103515245 + 12345;
+			int value = (seed >> 8) % (2 * searchLength);
+			int low = 0;
+			int high = searchLength - 1;
+			while(low < high){
+				int mid = (low + high) / 2;
+				if(value >= searchArray[mid].val)
+					low = mid + 1;
+				else
+					high = mid - 1;
+			}
+			sink = sink + low;
+		}
+		searchStepTime = std::chrono::duration<double>(clock::now() - start).count() / (searches * std::log2(searchLength));
+		delete[] searchArray;
+		
+		//Moving 256 elements over by one
+		const int moveLength = 256;
+		const int moves = 20000;
+		element* moveArray = new element[moveLength + 1];
+		memset(moveArray, 0, sizeof(element) * (moveLength + 1));
+		
+		start = clock::now();
+		for(int i = 0;i < moves;++i){
+			memmove(moveArray + (i & 1), moveArray + 1 - (i & 1), sizeof(element) * moveLength);
+			sink = sink + moveArray[i % moveLength].val;
+		}
+		moveElementTime = std::chrono::duration<double>(clock::now() - start).count() / ((double)moves * moveLength);
+		delete[] moveArray;
+		
+		//Following a random cycle through memory 4 times the size of the L2 cache (Sattolo's algorithm)
+		const int chaseLength = 4 * l2CacheSize / sizeof(int);
+		const int hops = 100000;
+		int* chase = new int[chaseLength];
+		for(int i = 0;i < chaseLength;++i){
+			chase[i] = i;
+		}
+		for(int i = chaseLength - 1;i > 0;--i){
+			seed = seed * 1103515245 + 12345;
+			int j = (seed >> 4) % i;
+			int swapperVariable = chase[i];
+			chase[i] = chase[j];
+			chase[j] = swapperVariable;
+		}
+		
+		int position = 0;
+		start = clock::now();
+		for(int i = 0;i < hops;++i){
+			position = chase[position];
+		}
+		sink = sink + position;
+		missTime = std::chrono::duration<double>(clock::now() - start).count() / hops;
+		delete[] chase;
+	}
+};
+
+
+//Pick the container size with the lowest estimated cost per insertion: a binary search on each nest level, with cache misses on the nest levels
+	//that don't fit in the L2 cache along with the nest levels above them (for the container and the parts of its array that are searched),
+	//plus the elements moved in the bottom nest level.
+//Containers are limited to the size of the L1 cache
+int tunedHalfMaxElements(int arrayLength){
+	static Calibration calibration;
+	
+	//Containers smaller than this spend more time on promotions and stepping between nest levels than the estimate below counts
+	const int minHalfMaxElements = 8;
+	
+	int bestHalfMaxElements = minHalfMaxElements;
+	double bestCost = 0;
+	for(int halfMaxElements = minHalfMaxElements;halfMaxElements <= arrayLength && 4 * halfMaxElements * (long)sizeof(element) <= calibration.l1CacheSize;
+		++halfMaxElements){
+		
+		int maxNestLevel = minimumNestLevel(arrayLength, halfMaxElements);
+		
+		int containers[64];	//most containers on each nest level
+		containers[maxNestLevel] = 1 + arrayLength / halfMaxElements;
+		for(int nestLevel = maxNestLevel - 1;nestLevel > 0;--nestLevel){
+			containers[nestLevel] = 1 + containers[nestLevel + 1] / halfMaxElements;
+		}
+		containers[0] = 1;
+		
+		double averageElements = 1.5 * halfMaxElements;	//containers hold between halfMaxElements and maxElements
+		double searchSteps = std::log2(averageElements + 1);
+		double cacheLinesSearched = 1 + std::log2(std::fmax(1.0, averageElements * sizeof(element) / 64));
+		
+		double cost = 0;
+		long footprint = 0;
+		for(int nestLevel = 0;nestLevel <= maxNestLevel;++nestLevel){
+			footprint += containers[nestLevel] * (sizeof(elementContainer) + 4L * halfMaxElements * sizeof(element));
+			cost += (searchSteps + 4) * calibration.searchStepTime;	//4 more for checking and stepping into the container
+			if(footprint > calibration.l2CacheSize)
+				cost += (1 + cacheLinesSearched) * calibration.missTime;
+		}
+		
+		//Insertion moves the smaller side of a container, a quarter of it on average. Once every halfMaxElements insertions a promotion
+			//copies another halfMaxElements elements into a new container and inserts into the parent
+		cost += (averageElements / 4 + 1) * calibration.moveElementTime;
+		cost += (calibration.missTime + searchSteps * calibration.searchStepTime) / halfMaxElements;
+		
+		if(bestCost == 0 || cost < bestCost){
+			bestCost = cost;
+			bestHalfMaxElements = halfMaxElements;
+		}
+	}
+	
+	return bestHalfMaxElements;
+}
+#endif
+
+
 class Benchmarks {
 	public:
 	int maxElements;	//Maximum amount of elements allowed in an element container
 	int halfMaxElements;
 	int dblMaxElements;
 	int maxNestLevel;
+	int maxContainers;	//Most containers the sort can use. Each container uses dblMaxElements elements
 	Benchmarks(int arrayLength){
-		halfMaxElements = log2(arrayLength);
+		#ifdef AUTO_TUNE
+		halfMaxElements = tunedHalfMaxElements(arrayLength);
+		#else
+		halfMaxElements = (arrayLength < 4) ? 2 : log2(arrayLength);	//At least 2, or each nest level would hold no fewer containers than the last
+		#endif
+		maxNestLevel = minimumNestLevel(arrayLength, halfMaxElements);
 		maxElements = 2 * halfMaxElements;	//Must be even
 		dblMaxElements = 4 * halfMaxElements;
-		maxNestLevel = log2(arrayLength) / floor(log2(halfMaxElements));
+		maxContainers = ::maxContainers(arrayLength, halfMaxElements, maxNestLevel);
 	}
 };
 
@@ -88,29 +268,19 @@ class Benchmarks {
 void insertElement(int value,elementContainer* destination, Benchmarks* const bm, elementContainer*& containerAssigner, element*& elementAssigner){
 	
 	bool isHigherThanMedian;
-	int valuePosition; //The index of the greatest value less than or equal to the value to be inserted
+	int valuePosition; //The index of the greatest value less than or equal to the value to be inserted, firstElementIndex - 1 if there is none
 	int low;
 	int high;
 	int mid;
+	elementContainer* nestedContainer;
 	
 	//Loop until the lowest nest level is reached
 	while(true){
 		low = destination->firstElementIndex;
 		high = destination->lastElementIndex;
-		mid = (low+high) / 2;
-		
-		//Check to see if the value to insert is higher or lower than the median, while updating low / high value for binary search
-		if(value >= destination->array[mid].val){
-			isHigherThanMedian = true;
-			low = mid + 1;
-		}
-		else{
-			isHigherThanMedian = false;
-			high = mid - 1;
-		}
 		
-		//binary search
-		while(low < high){
+		//binary search, ending with high at the greatest value less than or equal to the value to be inserted
+		while(low <= high){
 			mid = (low + high) / 2;
 			
 			if(value >= destination->array[mid].val)
@@ -118,23 +288,25 @@ void insertElement(int value,elementContainer* destination, Benchmarks* const bm
 			else
 				high = mid - 1;
 		}
+		valuePosition = high;
 		
-		//use high to compare and assign, 
-			//(either low or high would work if used in all 3 appearances, but high is used to make the first element insertion trick work)
-		if(value >= destination->array[high].val)
-			valuePosition = high;
-		else
-			valuePosition = high - 1;
+		//Check to see if the value to insert is higher or lower than the median
+		isHigherThanMedian = (valuePosition >= (destination->firstElementIndex + destination->lastElementIndex) / 2);
 		
 		
 		if(destination->nestLevel < bm->maxNestLevel){
+			//values before the first element go in the container's own nested container
+			if(valuePosition < destination->firstElementIndex)
+				nestedContainer = destination->nestedContainer;
+			else
+				nestedContainer = destination->array[valuePosition].nestedContainer;
+			
 			//if the nested container is at max capacity, promote
-			if((destination->array[valuePosition].nestedContainer->lastElementIndex - destination->array[valuePosition].nestedContainer->firstElementIndex + 1) 
-				== bm->maxElements){
-					destination = promote(destination, valuePosition, value, isHigherThanMedian, bm, containerAssigner, elementAssigner);
+			if((nestedContainer->lastElementIndex - nestedContainer->firstElementIndex + 1) == bm->maxElements){
+				destination = promote(destination, valuePosition, value, isHigherThanMedian, bm, containerAssigner, elementAssigner);
 			}
 			else{
-				destination = destination->array[valuePosition].nestedContainer;
+				destination = nestedContainer;
 			}
 			continue;
 		}
@@ -172,14 +344,18 @@ void insertElement(int value,elementContainer* destination, Benchmarks* const bm
 elementContainer* promote(elementContainer* parentContainer, const int& valuePosition, const int& insertedValue, const bool& isHigherThanMedian, 
 							Benchmarks* bm, elementContainer*& containerAssigner, element*& elementAssigner){
 
-	element *parentElement = parentContainer->array + valuePosition;
-	elementContainer* fullContainer = parentElement->nestedContainer;
+	//The full container is the parent element's nested container, or the parent container's own nested container if the value falls before its
+		//first element. lowerContainer refers to whichever one it is, so it can be reassigned
+	elementContainer*& lowerContainer = (valuePosition < parentContainer->firstElementIndex) ? 
+		parentContainer->nestedContainer : parentContainer->array[valuePosition].nestedContainer;
+	elementContainer* fullContainer = lowerContainer;
 	element promotedElement = fullContainer->array[fullContainer->firstElementIndex + bm->halfMaxElements];
 	
 	
 	//if the values are in indexes too low:
 		//assign the parent element's old container to the promoted element's nested container 
-		//set parent element to have a new nested container, and copy the first half of elements to that new container
+		//set parent element to have a new nested container, and copy the first half of elements (and the container of elements before them) 
+		//to that new container
 	//if the values are in indexes too high:
 		//assign the promoted element a new nested container. Copy the second half of the elements and assign it to the new container
 	//in both cases, after both the old parent element and the promoted element point to the correct nested container::
@@ -189,15 +365,17 @@ elementContainer* promote(elementContainer* parentContainer, const int& valuePos
 		promotedElement.nestedContainer = fullContainer;
 		
 		//Assign parentElement a new container
-		parentElement->nestedContainer = containerAssigner++;
-		parentElement->nestedContainer->array = elementAssigner;
+		lowerContainer = containerAssigner++;
+		lowerContainer->array = elementAssigner;
 		elementAssigner += bm->dblMaxElements;
-		parentElement->nestedContainer->firstElementIndex = bm->maxElements;
-		parentElement->nestedContainer->lastElementIndex = bm->maxElements + bm->halfMaxElements - 1;
-		parentElement->nestedContainer->acceptableFirstIndex = bm->halfMaxElements;
-		parentElement->nestedContainer->nestLevel = fullContainer->nestLevel;
+		lowerContainer->nestedContainer = fullContainer->nestedContainer;
+		lowerContainer->firstElementIndex = bm->maxElements;
+		lowerContainer->lastElementIndex = bm->maxElements + bm->halfMaxElements - 1;
+		lowerContainer->acceptableFirstIndex = bm->halfMaxElements;
+		lowerContainer->nestLevel = fullContainer->nestLevel;
+		fullContainer->nestedContainer = nullptr;
 		
-		memcpy(parentElement->nestedContainer->array + bm->maxElements,
+		memcpy(lowerContainer->array + bm->maxElements,
 				fullContainer->array + fullContainer->firstElementIndex,
 				sizeof(element) * bm->halfMaxElements);
 		
@@ -209,6 +387,7 @@ elementContainer* promote(elementContainer* parentContainer, const int& valuePos
 		promotedElement.nestedContainer = containerAssigner++;
 		promotedElement.nestedContainer->array = elementAssigner;
 		elementAssigner += bm->dblMaxElements;
+		promotedElement.nestedContainer->nestedContainer = nullptr;
 		promotedElement.nestedContainer->firstElementIndex = bm->maxElements;
 		promotedElement.nestedContainer->lastElementIndex = bm->maxElements + bm->halfMaxElements - 1;
 		promotedElement.nestedContainer->acceptableFirstIndex = bm->halfMaxElements;
@@ -223,11 +402,13 @@ elementContainer* promote(elementContainer* parentContainer, const int& valuePos
 	}
 	
 	
+	fullContainer = lowerContainer;	//The lower half, kept before the parent's elements are moved
+	
 	//Insert promotedElement into the non-full parent container
 	if(isHigherThanMedian){
 		//move the elements in the array over and insert the new value
-		memmove(parentElement + 2,
-			parentElement + 1,
+		memmove(parentContainer->array + valuePosition + 2,
+			parentContainer->array + valuePosition + 1,
 			sizeof(element) * (parentContainer->lastElementIndex - valuePosition));
 		
 		parentContainer->array[valuePosition + 1] = promotedElement;
@@ -240,18 +421,20 @@ elementContainer* promote(elementContainer* parentContainer, const int& valuePos
 			sizeof(element) * (valuePosition - parentContainer->firstElementIndex + 1));
 		parentContainer->array[valuePosition] = promotedElement;
 		--parentContainer->firstElementIndex;
-		--parentElement;	//The parent element was shifted, so decrement to point to the correct element
 	}
 	
 	
 	return (insertedValue >= promotedElement.val) ? 
 		promotedElement.nestedContainer : 
-		parentElement->nestedContainer;
+		fullContainer;
 }
 
 
 //Extract the elements from their nested elementContainers and put them in the correct, sorted order into a standard array
 void placeElementsInArray(elementContainer *source, int *array, const int& maxNestLevel, int& index){
+	if(source->nestLevel != maxNestLevel && source->nestedContainer != nullptr){
+		placeElementsInArray(source->nestedContainer, array, maxNestLevel, index);
+	}
 	for(int i = source -> firstElementIndex; i <= source -> lastElementIndex; ++i){
 		if(source->nestLevel == maxNestLevel){
 			array[index] = source->array[i].val;
@@ -266,8 +449,15 @@ void placeElementsInArray(elementContainer *source, int *array, const int& maxNe
 
 //Allocates memory for allContainers and allElements based on the array length
 void allocateMemory(int arrayLength, elementContainer*& allContainers, element*& allElements){
-	allContainers = new elementContainer[arrayLength];
-	allElements = new element[arrayLength * 8];
+	if(arrayLength <= 1){
+		allContainers = nullptr;
+		allElements = nullptr;
+		return;
+	}
+	
+	Benchmarks bm(arrayLength);
+	allContainers = new elementContainer[bm.maxContainers];
+	allElements = new element[(long)bm.maxContainers * bm.dblMaxElements];
 }
 //Deallocates memory for allContainers and allElements
 void deallocateMemory(elementContainer*& allContainers, element*& allElements){
@@ -300,39 +490,33 @@ void nestedArraySort(int *array, int arrayLength, elementContainer* containerAss
 	//n elements to the end (each element higher than the previous) or n elements to the beginning (each element lower than the previous)
 	parent->array = elementAssigner; 
 	elementAssigner += bm.dblMaxElements;	//Subsequent arrays will be assigned at elementAssigner so that two arrays never overlap
-	parent->array[bm.maxElements].val = -99999;//Add the initial element
 	
-	//Assign container values
+	//Assign container values. Containers start out empty, with firstElementIndex one past lastElementIndex
 	parent->firstElementIndex = bm.maxElements;	//halfway between the beginning and end of parent->array
-	parent->lastElementIndex = bm.maxElements;
+	parent->lastElementIndex = bm.maxElements - 1;
 	parent->acceptableFirstIndex = bm.halfMaxElements;
 	parent->nestLevel = 0;
 	
 	
-	//Assign the initial element containers
+	//Assign the initial containers of elements before the first element, one on each nest level
 	elementContainer* initAssigner = parent;
 	for(int i = 1;i <= bm.maxNestLevel;++i){
 		
 		//Create nested container
-		initAssigner->array[bm.maxElements].nestedContainer = containerAssigner++;
+		initAssigner->nestedContainer = containerAssigner++;
 				
 		//Move down to the nested container
-		initAssigner = initAssigner->array[bm.maxElements].nestedContainer;
+		initAssigner = initAssigner->nestedContainer;
 		initAssigner->array = elementAssigner;
 		elementAssigner += bm.dblMaxElements;
-		initAssigner->array[bm.maxElements].val = -99999;
 		
 		//Assign remaining container values
 		initAssigner->firstElementIndex = bm.maxElements;
-		initAssigner->lastElementIndex = bm.maxElements;
+		initAssigner->lastElementIndex = bm.maxElements - 1;
 		initAssigner->acceptableFirstIndex = bm.halfMaxElements;
 		initAssigner->nestLevel = i;
 	}
-	
-	//Trick to remove minimum value from the bottom nest level. 
-	//When the first value gets inserted, it gets inserted at lastElementIndex + 1, the firstElementIndex, and lastElementIndex gets incremented and matches
-	--initAssigner->lastElementIndex;
-	initAssigner->array[initAssigner->lastElementIndex].val = -99999;
+	initAssigner->nestedContainer = nullptr;
 	
 	
 	for(int i = 0;i < arrayLength;++i){
@@ -343,3 +527,577 @@ void nestedArraySort(int *array, int arrayLength, elementContainer* containerAss
 	placeElementsInArray(parent, array, bm.maxNestLevel, index);
 }
 
+
+
+/****************************************************************
+PROMOTION SET****************************************************
+*****************************************************************
+-PromotionSet keeps the nested containers of promotion sort alive as an ordered multiset. Containers are promoted (split in half) when they grow
+	past maxElements, and demoted (merged into a neighbouring container, the inverse of a promotion) when they shrink below minElements.
+-Unlike the sort, the amount of nest levels is not known ahead of time, so nestLevel counts up from the bottom nest level and a new top container is
+	created when the top container is promoted. Instead of the sort's containers of elements before the first element, when a value is lower than the
+	first element of a container it is inserted into the first element's nested container and the first element takes the lower value.
+-Elements above the bottom nest level hold a value less than or equal to all values in their nested container, so searches for the lower bound
+	of a value follow the greatest element less than the value.
+*****************************************************************/
+
+
+//Number of elements held in a container
+int containerSize(const elementContainer* container){
+	return container->lastElementIndex - container->firstElementIndex + 1;
+}
+
+//Move a container's elements so that they begin at newFirstIndex
+void moveElementsTo(elementContainer* container, int newFirstIndex){
+	int size = containerSize(container);
+	if(size > 0)
+		memmove(container->array + newFirstIndex, container->array + container->firstElementIndex, sizeof(element) * size);
+	container->firstElementIndex = newFirstIndex;
+	container->lastElementIndex = newFirstIndex + size - 1;
+}
+
+//Insert an element directly after position (firstElementIndex - 1 inserts at the beginning), moving whichever side of the container has fewer elements.
+//Returns the index the element was placed at
+int placeElement(elementContainer* container, int position, const element& newElement, int arrayLength){
+	bool moveLower = (position - container->firstElementIndex + 1) < (container->lastElementIndex - position);
+	
+	//if the side that has to move is at the end of the array, move the elements back to the middle
+	if((moveLower && container->firstElementIndex == 0) || (!moveLower && container->lastElementIndex == arrayLength - 1)){
+		int oldFirstIndex = container->firstElementIndex;
+		moveElementsTo(container, (arrayLength - containerSize(container)) / 2);
+		position += container->firstElementIndex - oldFirstIndex;
+	}
+	
+	if(moveLower){
+		memmove(container->array + container->firstElementIndex - 1, container->array + container->firstElementIndex,
+			sizeof(element) * (position - container->firstElementIndex + 1));
+		--container->firstElementIndex;
+		container->array[position] = newElement;
+		return position;
+	}
+	else{
+		memmove(container->array + position + 2, container->array + position + 1,
+			sizeof(element) * (container->lastElementIndex - position));
+		++container->lastElementIndex;
+		container->array[position + 1] = newElement;
+		return position + 1;
+	}
+}
+
+//Remove the element at position, moving whichever side of the container has fewer elements
+void removeElement(elementContainer* container, int position){
+	if(position - container->firstElementIndex < container->lastElementIndex - position){
+		memmove(container->array + container->firstElementIndex + 1, container->array + container->firstElementIndex,
+			sizeof(element) * (position - container->firstElementIndex));
+		++container->firstElementIndex;
+	}
+	else{
+		memmove(container->array + position, container->array + position + 1,
+			sizeof(element) * (container->lastElementIndex - position));
+		--container->lastElementIndex;
+	}
+}
+
+
+PromotionSet::PromotionSet(int halfMaxElements){
+	if(halfMaxElements < 8)
+		halfMaxElements = 8;	//Keeps every container but the top at 4 or more elements, so maxNestDepth is never reached
+	
+	this->halfMaxElements = halfMaxElements;
+	maxElements = 2 * halfMaxElements;
+	minElements = halfMaxElements / 2;
+	arrayLength = 2 * maxElements;
+	
+	freeContainersLength = 16;
+	freeContainers = new elementContainer*[freeContainersLength];
+	numFreeContainers = 0;
+	
+	topContainer = newContainer(0);
+	height = 0;
+	count = 0;
+}
+
+PromotionSet::~PromotionSet(){
+	deleteContainers(topContainer);
+	for(int i = 0;i < numFreeContainers;++i){
+		delete[] freeContainers[i]->array;
+		delete freeContainers[i];
+	}
+	delete[] freeContainers;
+}
+
+
+//Get an empty container, reusing one released by a demotion if there is one
+elementContainer* PromotionSet::newContainer(int nestLevel){
+	elementContainer* container;
+	if(numFreeContainers > 0){
+		container = freeContainers[--numFreeContainers];
+	}
+	else{
+		container = new elementContainer;
+		container->array = new element[arrayLength];
+	}
+	
+	container->firstElementIndex = arrayLength / 2;
+	container->lastElementIndex = container->firstElementIndex - 1;
+	container->nestLevel = nestLevel;
+	container->acceptableFirstIndex = halfMaxElements;
+	return container;
+}
+
+void PromotionSet::releaseContainer(elementContainer* container){
+	if(numFreeContainers == freeContainersLength){
+		elementContainer** grownFreeContainers = new elementContainer*[2 * freeContainersLength];
+		memcpy(grownFreeContainers, freeContainers, sizeof(elementContainer*) * numFreeContainers);
+		delete[] freeContainers;
+		freeContainers = grownFreeContainers;
+		freeContainersLength *= 2;
+	}
+	freeContainers[numFreeContainers++] = container;
+}
+
+void PromotionSet::deleteContainers(elementContainer* container){
+	if(container->nestLevel > 0){
+		for(int i = container->firstElementIndex; i <= container->lastElementIndex; ++i){
+			deleteContainers(container->array[i].nestedContainer);
+		}
+	}
+	delete[] container->array;
+	delete container;
+}
+
+
+void PromotionSet::insert(int value){
+	elementContainer* pathContainer[maxNestDepth];
+	int pathPosition[maxNestDepth];
+	
+	int low;
+	int high;
+	int mid;
+	
+	elementContainer* destination = topContainer;
+	for(int level = 0;level < height;++level){
+		//binary search for the greatest element less than or equal to the value
+		low = destination->firstElementIndex;
+		high = destination->lastElementIndex;
+		while(low < high){
+			mid = (low + high + 1) / 2;
+			if(destination->array[mid].val <= value)
+				low = mid;
+			else
+				high = mid - 1;
+		}
+		
+		//if the value is lower than all elements, the first element takes the value so it stays less than or equal to its nested container
+		if(value < destination->array[low].val)
+			destination->array[low].val = value;
+		
+		pathContainer[level] = destination;
+		pathPosition[level] = low;
+		destination = destination->array[low].nestedContainer;
+	}
+	
+	//binary search for the first element greater than the value on the bottom nest level, and insert before it
+	low = destination->firstElementIndex;
+	high = destination->lastElementIndex + 1;
+	while(low < high){
+		mid = (low + high) / 2;
+		if(destination->array[mid].val <= value)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	
+	element newElement;
+	newElement.val = value;
+	newElement.nestedContainer = nullptr;
+	pathContainer[height] = destination;
+	pathPosition[height] = placeElement(destination, low - 1, newElement, arrayLength);
+	++count;
+	
+	//Promote full containers, which can trigger a promotion in each container above them
+	for(int level = height;level >= 0 && containerSize(pathContainer[level]) > maxElements;--level){
+		promote(pathContainer, pathPosition, level);
+	}
+}
+
+
+//Split the container at the given level of the path in half by promoting the first element of its upper half to the container above
+void PromotionSet::promote(elementContainer** pathContainer, int* pathPosition, int level){
+	elementContainer* fullContainer = pathContainer[level];
+	int lowerSize = containerSize(fullContainer) / 2;
+	int upperSize = containerSize(fullContainer) - lowerSize;
+	
+	//Copy the upper half to a new container, and discard it from the full container
+	elementContainer* promotedContainer = newContainer(fullContainer->nestLevel);
+	promotedContainer->firstElementIndex = (arrayLength - upperSize) / 2;
+	promotedContainer->lastElementIndex = promotedContainer->firstElementIndex + upperSize - 1;
+	memcpy(promotedContainer->array + promotedContainer->firstElementIndex,
+			fullContainer->array + fullContainer->firstElementIndex + lowerSize,
+			sizeof(element) * upperSize);
+	fullContainer->lastElementIndex -= upperSize;
+	
+	element promotedElement;
+	promotedElement.val = promotedContainer->array[promotedContainer->firstElementIndex].val;
+	promotedElement.nestedContainer = promotedContainer;
+	
+	//Keep the path pointing at the same element, which may have moved to the upper half
+	bool isPathInUpperHalf = pathPosition[level] > fullContainer->lastElementIndex;
+	if(isPathInUpperHalf){
+		pathPosition[level] += promotedContainer->firstElementIndex - (fullContainer->lastElementIndex + 1);
+		pathContainer[level] = promotedContainer;
+	}
+	
+	//if the top container is full, create a new top container holding both halves
+	if(level == 0){
+		elementContainer* newTopContainer = newContainer(fullContainer->nestLevel + 1);
+		
+		element lowerElement;
+		lowerElement.val = fullContainer->array[fullContainer->firstElementIndex].val;
+		lowerElement.nestedContainer = fullContainer;
+		
+		placeElement(newTopContainer, newTopContainer->lastElementIndex, lowerElement, arrayLength);
+		placeElement(newTopContainer, newTopContainer->lastElementIndex, promotedElement, arrayLength);
+		
+		//The path gains a level at the top
+		for(int i = height;i >= 0;--i){
+			pathContainer[i + 1] = pathContainer[i];
+			pathPosition[i + 1] = pathPosition[i];
+		}
+		pathContainer[0] = newTopContainer;
+		pathPosition[0] = isPathInUpperHalf ? newTopContainer->lastElementIndex : newTopContainer->firstElementIndex;
+		
+		topContainer = newTopContainer;
+		++height;
+		return;
+	}
+	
+	int promotedPosition = placeElement(pathContainer[level - 1], pathPosition[level - 1], promotedElement, arrayLength);
+	pathPosition[level - 1] = isPathInUpperHalf ? promotedPosition : promotedPosition - 1;
+}
+
+
+//Insert a sorted run of values. The position of each bottom container the run falls into is found once, and the values belonging there are merged
+	//with the container's elements and spliced in as new containers, instead of being searched for and moved one at a time
+void PromotionSet::insertRun(const int* run, int runLength){
+	elementContainer* pathContainer[maxNestDepth];
+	int pathPosition[maxNestDepth];
+	
+	int* mergedValues = new int[maxElements + runLength];
+	const int pieceSize = (halfMaxElements + maxElements) / 2;	//Leave room in new containers for later insertions
+	
+	int low;
+	int high;
+	int mid;
+	
+	int runIndex = 0;
+	while(runIndex < runLength){
+		int value = run[runIndex];
+		
+		//Find the bottom container like insert(), along with the lowest element after the path. Values from that element on belong further along
+		bool hasUpperBound = false;
+		int upperBound = 0;
+		elementContainer* destination = topContainer;
+		for(int level = 0;level < height;++level){
+			low = destination->firstElementIndex;
+			high = destination->lastElementIndex;
+			while(low < high){
+				mid = (low + high + 1) / 2;
+				if(destination->array[mid].val <= value)
+					low = mid;
+				else
+					high = mid - 1;
+			}
+			
+			if(value < destination->array[low].val)
+				destination->array[low].val = value;
+			
+			if(low < destination->lastElementIndex && (!hasUpperBound || destination->array[low + 1].val < upperBound)){
+				upperBound = destination->array[low + 1].val;
+				hasUpperBound = true;
+			}
+			
+			pathContainer[level] = destination;
+			pathPosition[level] = low;
+			destination = destination->array[low].nestedContainer;
+		}
+		pathContainer[height] = destination;
+		
+		int runEnd = runIndex + 1;
+		while(runEnd < runLength && (!hasUpperBound || run[runEnd] < upperBound))
+			++runEnd;
+		
+		count += runEnd - runIndex;
+		
+		//if the values fit in the container, insert them directly
+		if(containerSize(destination) + runEnd - runIndex <= maxElements){
+			int position = destination->firstElementIndex;
+			element newElement;
+			newElement.nestedContainer = nullptr;
+			for(;runIndex < runEnd;++runIndex){
+				newElement.val = run[runIndex];
+				while(position <= destination->lastElementIndex && destination->array[position].val <= newElement.val)
+					++position;
+				position = placeElement(destination, position - 1, newElement, arrayLength) + 1;
+			}
+			continue;
+		}
+		
+		//Merge the container's values with the run's values, the container's values first when they are equal
+		int containerIndex = destination->firstElementIndex;
+		int mergedLength = 0;
+		for(int i = runIndex;i < runEnd;++i){
+			while(containerIndex <= destination->lastElementIndex && destination->array[containerIndex].val <= run[i]){
+				mergedValues[mergedLength++] = destination->array[containerIndex++].val;
+			}
+			mergedValues[mergedLength++] = run[i];
+		}
+		while(containerIndex <= destination->lastElementIndex){
+			mergedValues[mergedLength++] = destination->array[containerIndex++].val;
+		}
+		
+		runIndex = runEnd;
+		
+		//Split the merged values evenly into as many containers as needed. The first keeps using the destination container
+		int pieceCount = (mergedLength + pieceSize - 1) / pieceSize;
+		int mergedIndex = 0;
+		for(int piece = 0;piece < pieceCount;++piece){
+			int size = mergedLength / pieceCount + (piece < mergedLength % pieceCount ? 1 : 0);
+			
+			elementContainer* pieceContainer = (piece == 0) ? destination : newContainer(0);
+			pieceContainer->firstElementIndex = (arrayLength - size) / 2;
+			pieceContainer->lastElementIndex = pieceContainer->firstElementIndex + size - 1;
+			for(int i = pieceContainer->firstElementIndex;i <= pieceContainer->lastElementIndex;++i){
+				pieceContainer->array[i].val = mergedValues[mergedIndex++];
+				pieceContainer->array[i].nestedContainer = nullptr;
+			}
+			
+			if(piece == 0)
+				continue;
+			
+			//if the bottom container is the top container, create a new top container above it
+			if(height == 0){
+				elementContainer* newTopContainer = newContainer(1);
+				element lowerElement;
+				lowerElement.val = destination->array[destination->firstElementIndex].val;
+				lowerElement.nestedContainer = destination;
+				pathPosition[0] = placeElement(newTopContainer, newTopContainer->lastElementIndex, lowerElement, arrayLength);
+				pathContainer[0] = newTopContainer;
+				topContainer = newTopContainer;
+				height = 1;
+			}
+			
+			//Promote the new container's first element after the previous piece, and follow it down the path
+			element promotedElement;
+			promotedElement.val = pieceContainer->array[pieceContainer->firstElementIndex].val;
+			promotedElement.nestedContainer = pieceContainer;
+			pathPosition[height - 1] = placeElement(pathContainer[height - 1], pathPosition[height - 1], promotedElement, arrayLength);
+			pathContainer[height] = pieceContainer;
+			
+			for(int level = height - 1;level >= 0 && containerSize(pathContainer[level]) > maxElements;--level){
+				promote(pathContainer, pathPosition, level);
+			}
+		}
+	}
+	
+	delete[] mergedValues;
+}
+
+
+bool PromotionSet::erase(int value){
+	iterator location;
+	findLowerBound(value, location);
+	if(location.height == -1 || *location != value)
+		return false;
+	
+	removeElement(location.pathContainer[height], location.pathPosition[height]);
+	--count;
+	
+	//Demote containers that are too small, which can trigger a demotion in each container above them
+	for(int level = height;level > 0 && containerSize(location.pathContainer[level]) < minElements;--level){
+		demote(location.pathContainer, location.pathPosition, level);
+	}
+	
+	//Remove top containers that only hold a single nested container
+	while(height > 0 && containerSize(topContainer) == 1){
+		elementContainer* oldTopContainer = topContainer;
+		topContainer = topContainer->array[topContainer->firstElementIndex].nestedContainer;
+		releaseContainer(oldTopContainer);
+		--height;
+	}
+	
+	return true;
+}
+
+
+//Merge the container at the given level of the path into a neighbouring container, removing its element from the container above.
+//If both containers together would be too large to merge, move elements from the larger container to the smaller one instead
+void PromotionSet::demote(elementContainer** pathContainer, int* pathPosition, int level){
+	elementContainer* parentContainer = pathContainer[level - 1];
+	int position = pathPosition[level - 1];
+	
+	elementContainer* lowerContainer;
+	elementContainer* upperContainer;
+	int upperPosition;	//position of the element associated with upperContainer
+	if(position > parentContainer->firstElementIndex){
+		lowerContainer = parentContainer->array[position - 1].nestedContainer;
+		upperContainer = pathContainer[level];
+		upperPosition = position;
+	}
+	else if(position < parentContainer->lastElementIndex){
+		lowerContainer = pathContainer[level];
+		upperContainer = parentContainer->array[position + 1].nestedContainer;
+		upperPosition = position + 1;
+	}
+	else return;	//The only container in the top container. It will become the top container
+	
+	int lowerSize = containerSize(lowerContainer);
+	int upperSize = containerSize(upperContainer);
+	
+	if(lowerSize + upperSize <= maxElements){
+		if(lowerContainer->lastElementIndex + upperSize >= arrayLength)
+			moveElementsTo(lowerContainer, (arrayLength - lowerSize - upperSize) / 2);
+		
+		memcpy(lowerContainer->array + lowerContainer->lastElementIndex + 1,
+				upperContainer->array + upperContainer->firstElementIndex,
+				sizeof(element) * upperSize);
+		lowerContainer->lastElementIndex += upperSize;
+		
+		removeElement(parentContainer, upperPosition);
+		releaseContainer(upperContainer);
+		return;
+	}
+	
+	if(lowerSize > upperSize){
+		//Move the last elements of the lower container to the beginning of the upper container
+		int moveCount = (lowerSize - upperSize) / 2;
+		if(upperContainer->firstElementIndex < moveCount)
+			moveElementsTo(upperContainer, (arrayLength - upperSize - moveCount) / 2 + moveCount);
+		
+		upperContainer->firstElementIndex -= moveCount;
+		memcpy(upperContainer->array + upperContainer->firstElementIndex,
+				lowerContainer->array + lowerContainer->lastElementIndex - moveCount + 1,
+				sizeof(element) * moveCount);
+		lowerContainer->lastElementIndex -= moveCount;
+	}
+	else{
+		//Move the first elements of the upper container to the end of the lower container
+		int moveCount = (upperSize - lowerSize) / 2;
+		if(lowerContainer->lastElementIndex + moveCount >= arrayLength)
+			moveElementsTo(lowerContainer, (arrayLength - lowerSize - moveCount) / 2);
+		
+		memcpy(lowerContainer->array + lowerContainer->lastElementIndex + 1,
+				upperContainer->array + upperContainer->firstElementIndex,
+				sizeof(element) * moveCount);
+		lowerContainer->lastElementIndex += moveCount;
+		upperContainer->firstElementIndex += moveCount;
+	}
+	
+	parentContainer->array[upperPosition].val = upperContainer->array[upperContainer->firstElementIndex].val;
+}
+
+
+//Fill location with the path to the first element not less than value, or make it the end iterator if there is none
+void PromotionSet::findLowerBound(int value, iterator& location) const{
+	int low;
+	int high;
+	int mid;
+	
+	elementContainer* destination = topContainer;
+	for(int level = 0;level < height;++level){
+		//binary search for the greatest element less than the value, or the first element if there is none
+		low = destination->firstElementIndex;
+		high = destination->lastElementIndex;
+		while(low < high){
+			mid = (low + high + 1) / 2;
+			if(destination->array[mid].val < value)
+				low = mid;
+			else
+				high = mid - 1;
+		}
+		
+		location.pathContainer[level] = destination;
+		location.pathPosition[level] = low;
+		destination = destination->array[low].nestedContainer;
+	}
+	
+	//binary search for the first element not less than the value on the bottom nest level
+	low = destination->firstElementIndex;
+	high = destination->lastElementIndex + 1;
+	while(low < high){
+		mid = (low + high) / 2;
+		if(destination->array[mid].val < value)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	
+	location.height = height;
+	location.pathContainer[height] = destination;
+	location.pathPosition[height] = low - 1;
+	++location;	//Steps onto low, or onto the next container when all of this container's elements are less than the value
+}
+
+
+PromotionSet::iterator PromotionSet::lowerBound(int value) const{
+	iterator location;
+	findLowerBound(value, location);
+	return location;
+}
+
+PromotionSet::iterator PromotionSet::find(int value) const{
+	iterator location;
+	findLowerBound(value, location);
+	if(location.height != -1 && *location != value)
+		location.height = -1;
+	return location;
+}
+
+PromotionSet::iterator PromotionSet::begin() const{
+	iterator location;
+	if(count == 0)
+		return location;
+	
+	elementContainer* destination = topContainer;
+	for(int level = 0;level <= height;++level){
+		location.pathContainer[level] = destination;
+		location.pathPosition[level] = destination->firstElementIndex;
+		destination = destination->array[destination->firstElementIndex].nestedContainer;
+	}
+	location.height = height;
+	return location;
+}
+
+
+int PromotionSet::iterator::operator*() const{
+	return pathContainer[height]->array[pathPosition[height]].val;
+}
+
+PromotionSet::iterator& PromotionSet::iterator::operator++(){
+	//Move up until a container has an element after the one in the path
+	int level = height;
+	++pathPosition[level];
+	while(pathPosition[level] > pathContainer[level]->lastElementIndex){
+		if(level == 0){
+			height = -1;
+			return *this;
+		}
+		--level;
+		++pathPosition[level];
+	}
+	
+	//Move back down to the first element of each nested container
+	while(level < height){
+		elementContainer* nestedContainer = pathContainer[level]->array[pathPosition[level]].nestedContainer;
+		++level;
+		pathContainer[level] = nestedContainer;
+		pathPosition[level] = nestedContainer->firstElementIndex;
+	}
+	return *this;
+}
+
+bool PromotionSet::iterator::operator==(const iterator& other) const{
+	if(height == -1 || other.height == -1)
+		return height == other.height;
+	return pathContainer[height] == other.pathContainer[other.height] && pathPosition[height] == other.pathPosition[other.height];
+}
@@ -0,0 +1,76 @@
+
+#ifndef promotion_sort
+#define promotion_sort
+
+struct elementContainer; struct element;
+
+
+//Perform promotion sort with internal allocation/deallocation of memory
+void nestedArraySort(int *array, int arrayLength);
+//Perform promotion sort with external allocation/deallocation of memory
+void nestedArraySort(int *array, int arrayLength, elementContainer* containerAssigner, element* elementAssigner);
+
+//Allocates memory for allContainers and allElements based on the array length
+void allocateMemory(int arrayLength, elementContainer*& allContainers, element*& allElements);
+//Deallocates memory for allContainers and allElements
+void deallocateMemory(elementContainer*& allContainers, element*& allElements);
+
+
+//Ordered multiset built from promotion sort's nested containers. Values are only held in the bottom nest level, each element above the bottom
+	//holds the lowest value of its nested container (or lower) and is used to find where a value belongs.
+class PromotionSet {
+	public:
+	static const int maxNestDepth = 20;	//Enough for 2^32 elements with the smallest allowed containers
+
+	//Forward iterator over the values in sorted order. Holds the path of containers from the top nest level down to the current element
+	class iterator {
+		friend class PromotionSet;
+		elementContainer* pathContainer[maxNestDepth];
+		int pathPosition[maxNestDepth];
+		int height;	//index of the bottom nest level in the path, -1 for the end iterator
+
+		public:
+		iterator(){ height = -1; }
+		int operator*() const;
+		iterator& operator++();
+		bool operator==(const iterator& other) const;
+		bool operator!=(const iterator& other) const { return !(*this == other); }
+	};
+
+	PromotionSet(int halfMaxElements = 32);
+	~PromotionSet();
+	PromotionSet(const PromotionSet&) = delete;
+	PromotionSet& operator=(const PromotionSet&) = delete;
+
+	void insert(int value);
+	void insertRun(const int* run, int runLength);	//Insert a run of values sorted from lowest to highest
+	bool erase(int value);	//Erase one element equal to value, returns false if there is none
+	iterator find(int value) const;
+	iterator lowerBound(int value) const;	//First element not less than value
+	iterator begin() const;
+	iterator end() const { return iterator(); }
+	int size() const { return count; }
+
+	private:
+	int halfMaxElements;
+	int maxElements;	//A container is promoted (split in two) when it exceeds this many elements
+	int minElements;	//A container is demoted (merged with a neighbour) or refilled when it falls below this many elements
+	int arrayLength;	//Length of each container's array, leaving room to insert on either side of the elements
+
+	elementContainer* topContainer;
+	int height;	//Number of nest levels below topContainer
+	int count;
+
+	elementContainer** freeContainers;	//Containers released by demotions, reused before allocating new ones
+	int numFreeContainers;
+	int freeContainersLength;
+
+	elementContainer* newContainer(int nestLevel);
+	void releaseContainer(elementContainer* container);
+	void deleteContainers(elementContainer* container);
+	void promote(elementContainer** pathContainer, int* pathPosition, int level);
+	void demote(elementContainer** pathContainer, int* pathPosition, int level);
+	void findLowerBound(int value, iterator& location) const;
+};
+
+#endif
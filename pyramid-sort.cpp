@@ -1,6 +1,11 @@
 //Pyramid sort
 
 #include <cmath>
+#include <cstring>	//memmove
+#include <algorithm>	//min
+#include <utility>	//index_sequence
+#include <climits>	//INT_MAX
+#include <thread>	//yield
 
 
 /****************************************************************
@@ -19,8 +24,8 @@ There is a small conceptual difference between pyramid sort and promotion sort a
 	a tight, evenly distributed tree, or, as I am tentatively calling it, a pyramid). The reason for this is that upon evaluating promotion sort I found
 	out that the binary search evaluated on each nested array was a bottleneck. By limiting the amount of elements to 1 or 2, no binary search is required:
 	only a single comparison to the first element is required, and in cases where the comparison is >=, a comparison to the second element if it exists.
-	-In pyramid sort, each container has a nested array of all elements that fall before the first element. Promotion sort uses a worse solution to handling
-	elements that fall before any values in the parent that involves absolute minimums and duplicating elements.
+	-In pyramid sort, each container has a nested array of all elements that fall before the first element. Promotion sort used a worse solution to handling
+	elements that fall before any values in the parent that involved absolute minimums, and has since been changed to do the same.
 	-Checks for promotion happen once the bottom nest level is reached rather than at each nest level while searching down. This means that a promotion
 	can cause successive promotions, but less checks for promotions have to happen in total.
 	-In pyramid sort, memory is allocated in a more localized way to prevent cache misses, whereas in promotion sort memory location depends on when 
@@ -32,9 +37,13 @@ Further possible optimizations:
 	functions during runtime, because the while loop executes a set amount of times based on how many levels up the superParent is. So instead of checking
 	if the bottom nest level is reached every time, a new function could be created every time superParentPromote() is called that executed the contents
 	of the while loop 1 extra time.
+	(Done with templates rather than at runtime: findInsertLocUnrolled is instantiated for every depth up to maxUnrolledDepth, and pyramidSort switches
+	to the next one each time the superParent is promoted)
 	-Using std::move rather than standard copy assignment on the operations in promote() and insertValue() tht happen O(n) times
 	-For small arrays (probably under 10000 elements or so), the high cost of promotion would not be worth doing as often as happens in pyramid sort. It 
 	would be beneficial in those cases if each container held 2-4 elements instead of 1-2.
+	(Tried in widePyramidSort below. It turned out the other way around: below a couple thousand elements 1-2 elements per container is fastest, and above
+	that containers of up to 16 elements were 2-3 times faster, because the pyramid is shallower and has fewer cache misses)
 	-For data entries that aren't presumed to be random / of indeterminite order, promotion sort with the optimizations incorporated in this file would
 	probably be a faster data structure. Inserting many contiguous elements at once would be faster if array sizes were larger. An example I can think of
 	would be a text editor adding elements somewhere in the middle of tens of thousands of chararacters of text: creating a few new nested arrays at the
@@ -44,7 +53,7 @@ Further possible optimizations:
 *****************************************************************/
 
 
-struct element; struct elementContainer;
+#include "pyramid-sort.h"
 
 //Element data struct contains the value of the element and the nested array that is associated with it
 struct element{
@@ -60,10 +69,31 @@ struct elementContainer{
 	element element0;
 	element element1;
 	bool hasTwoElements;
+	#ifdef VALUE_COUNTS
+	int valueCount;	//Values in the container and its nested containers. Kept by PyramidQueue and buildPyramid, not by pyramidSort's promotions
+	#endif
 };
 
 
-elementContainer* promote(elementContainer* parent, int promotedValue, elementContainer*& superParent, int level,
+#ifdef VALUE_COUNTS
+//Count the values in container from its elements and its nested containers' counts
+inline void countContainerValues(elementContainer* container){
+	container->valueCount = container->hasTwoElements ? 2 : 1;
+	if(container->nestedContainer != nullptr){
+		container->valueCount += container->nestedContainer->valueCount + container->element0.nestedContainer->valueCount;
+		if(container->hasTwoElements)
+			container->valueCount += container->element1.nestedContainer->valueCount;
+	}
+}
+#define addValueCount(container, values) ((container)->valueCount += (values))
+#define recountValues(container) countContainerValues(container)
+#else
+#define addValueCount(container, values) ((void)0)
+#define recountValues(container) ((void)0)
+#endif
+
+
+elementContainer* promote(elementContainer* parent, elementContainer* source, int promotedValue, elementContainer*& superParent, int level,
 							elementContainer** containerAssigner);
 
 elementContainer* superParentPromote(int promotedValue, elementContainer*& superParent, int level, 
@@ -101,6 +131,50 @@ elementContainer* findInsertLoc(int value, elementContainer* destination){
 	return destination;
 }
 
+//The nested container of destination that a value belongs in
+inline elementContainer* nextContainer(int value, elementContainer* destination){
+	if(value >= destination->element0.val){
+		if(!destination->hasTwoElements || value < destination->element1.val)
+			return destination->element0.nestedContainer;
+		else
+			return destination->element1.nestedContainer;
+	}
+	else{
+		return destination->nestedContainer;
+	}
+}
+
+//Find the location where an element should be inserted, going down a set number of nest levels. The recursion is unrolled at compile time, so the
+	//nested containers don't have to be checked to find the bottom nest level
+template<int depth>
+elementContainer* findInsertLocUnrolled(int value, elementContainer* destination){
+	return findInsertLocUnrolled<depth - 1>(value, nextContainer(value, destination));
+}
+
+template<>
+elementContainer* findInsertLocUnrolled<0>(int /*value*/, elementContainer* destination){
+	return destination;
+}
+
+
+typedef elementContainer* (*findInsertLocFunction)(int value, elementContainer* destination);
+
+const int maxUnrolledDepth = 40;	//Deeper than any pyramid of 2^31 elements. Deeper pyramids fall back to findInsertLoc
+
+//Table of findInsertLocUnrolled for each depth, findInsertLocTable[depth] goes down depth nest levels
+template<int... depths>
+const findInsertLocFunction* makeFindInsertLocTable(std::integer_sequence<int, depths...>){
+	static const findInsertLocFunction table[] = {findInsertLocUnrolled<depths>...};
+	return table;
+}
+const findInsertLocFunction* const findInsertLocTable = makeFindInsertLocTable(std::make_integer_sequence<int, maxUnrolledDepth + 1>());
+
+//The function that finds the insert location in a pyramid with depth nest levels below the superParent
+findInsertLocFunction findInsertLocForDepth(int depth){
+	return (depth <= maxUnrolledDepth) ? findInsertLocTable[depth] : findInsertLoc;
+}
+
+
 //Insert a value into the bottom level
 void insertValue(int value, elementContainer* destination, elementContainer*& superParent, elementContainer** containerAssigner){
 	
@@ -112,7 +186,7 @@ void insertValue(int value, elementContainer* destination, elementContainer*& su
 		//promote the second highest value, assign the highest value as the element in the new container
 		if(value >= destination->element0.val){
 			if(value >= destination->element1.val){
-				newContainer = promote(destination->parentContainer, destination->element1.val, superParent, 0, containerAssigner);
+				newContainer = promote(destination->parentContainer, destination, destination->element1.val, superParent, 0, containerAssigner);
 				
 				//assign values to the new container's members, excluding parentContainer
 				newContainer->hasTwoElements = false;
@@ -121,7 +195,7 @@ void insertValue(int value, elementContainer* destination, elementContainer*& su
 				newContainer->element0.val = value;
 			}
 			else{
-				newContainer = promote(destination->parentContainer, value, superParent, 0, containerAssigner);
+				newContainer = promote(destination->parentContainer, destination, value, superParent, 0, containerAssigner);
 				
 				//assign values to the new container's members, excluding parentContainer
 				newContainer->hasTwoElements = false;
@@ -131,7 +205,7 @@ void insertValue(int value, elementContainer* destination, elementContainer*& su
 			}
 		}
 		else{
-			newContainer = promote(destination->parentContainer, destination->element0.val, superParent, 0, containerAssigner);
+			newContainer = promote(destination->parentContainer, destination, destination->element0.val, superParent, 0, containerAssigner);
 			
 			//assign values to the new container's members, excluding parentContainer
 			newContainer->hasTwoElements = false;
@@ -161,7 +235,9 @@ void insertValue(int value, elementContainer* destination, elementContainer*& su
 //Return that nested container to the calling function to assign values to its own element and nested containers.
 //All values to the new container are assigned by the calling function, to avoid the need to check for the presence of nested arrays 
 	//(when insertValue calls a promotion it doesn't have nested containers which would otherwise be accessed). Only the parent has to be assigned here.
-elementContainer* promote(elementContainer* parent, int promotedValue, elementContainer*& superParent, int level,
+//Which side of the parent the value goes on is found from source, the nested container it was promoted from, rather than by comparing values: a pyramid
+	//built by buildPyramid can hold values equal to an element before it as well as after it
+elementContainer* promote(elementContainer* parent, elementContainer* source, int promotedValue, elementContainer*& superParent, int level,
 							elementContainer** containerAssigner){
 	
 	//Trigger another promotion
@@ -174,8 +250,8 @@ elementContainer* promote(elementContainer* parent, int promotedValue, elementCo
 		if(parent->parentContainer == nullptr){
 			
 			//promote the second highest value to the new superparent, assign the highest value as the element in the new container
-			if(promotedValue >= parent->element0.val){
-				if(promotedValue >= parent->element1.val){
+			if(source != parent->nestedContainer){
+				if(source == parent->element1.nestedContainer){
 					newContainer = superParentPromote(parent->element1.val, superParent, level + 1, containerAssigner);
 					
 					//assign values to the new container's members, excluding parentContainer
@@ -231,9 +307,9 @@ elementContainer* promote(elementContainer* parent, int promotedValue, elementCo
 		else{
 			
 			//promote the second highest value, assign the highest value as the element in the new container
-			if(promotedValue >= parent->element0.val){
-				if(promotedValue >= parent->element1.val){
-					newContainer = promote(parent->parentContainer, parent->element1.val, superParent, level + 1, containerAssigner);
+			if(source != parent->nestedContainer){
+				if(source == parent->element1.nestedContainer){
+					newContainer = promote(parent->parentContainer, parent, parent->element1.val, superParent, level + 1, containerAssigner);
 					
 					//assign values to the new container's members, excluding parentContainer
 					newContainer->hasTwoElements = false;
@@ -249,7 +325,7 @@ elementContainer* promote(elementContainer* parent, int promotedValue, elementCo
 					return newContainer->element0.nestedContainer;
 				}
 				else{
-					newContainer = promote(parent->parentContainer, promotedValue, superParent, level + 1, containerAssigner);
+					newContainer = promote(parent->parentContainer, parent, promotedValue, superParent, level + 1, containerAssigner);
 					
 					//assign values to the new container's members, excluding parentContainer
 					newContainer->hasTwoElements = false;
@@ -265,7 +341,7 @@ elementContainer* promote(elementContainer* parent, int promotedValue, elementCo
 				}
 			}
 			else{
-				newContainer = promote(parent->parentContainer, parent->element0.val, superParent, level + 1, containerAssigner);
+				newContainer = promote(parent->parentContainer, parent, parent->element0.val, superParent, level + 1, containerAssigner);
 				
 				//assign values to the new container's members, excluding parentContainer
 				newContainer->hasTwoElements = false;
@@ -291,7 +367,7 @@ elementContainer* promote(elementContainer* parent, int promotedValue, elementCo
 	else{
 		parent->hasTwoElements = true;	//number of elements in parent will go up by 1
 		
-		if(promotedValue >= parent->element0.val){
+		if(source != parent->nestedContainer){
 			parent->element1.val = promotedValue;
 			
 			//create the new container that will be returned, and assign it the correct parent
@@ -367,6 +443,113 @@ void placeElementsInArray(elementContainer* source, int* array, int& index){
 }
 
 
+#if defined(__GNUC__)
+#define prefetchContainer(container) __builtin_prefetch(container)
+#else
+#define prefetchContainer(container)
+#endif
+
+const int insertBatchSize = 16;	//Most values inserted together by insertBatch
+const int minBatchedArrayLength = 50000;	//pyramidSort inserts in batches for arrays at least this long, smaller pyramids fit in the cache
+const int minBulkLength = 3;	//pyramidSort builds a sorted prefix at least this long into a pyramid rather than inserting it (one with a superParent above the bottom)
+
+//Insert up to insertBatchSize values. The values go down the pyramid together one nest level at a time, prefetching the next container of each, so 
+	//the cache misses of different values overlap instead of following one after another. They are then inserted in order.
+	//A promotion only changes which values belong in the bottom container it starts from (the values above its promoted element now belong in the new 
+	//container), so only the later values headed for that container have to go down the pyramid again
+void insertBatch(const int* values, int batchLength, elementContainer*& superParent, int& depth, elementContainer** containerAssigner){
+	elementContainer* destinations[insertBatchSize];
+	for(int j = 0;j < batchLength;++j)
+		destinations[j] = superParent;
+	
+	for(int level = depth;level > 0;--level){
+		for(int j = 0;j < batchLength;++j){
+			destinations[j] = nextContainer(values[j], destinations[j]);
+			prefetchContainer(destinations[j]);
+		}
+	}
+	
+	for(int j = 0;j < batchLength;++j){
+		elementContainer* destination = destinations[j];
+		bool isPromoting = destination->hasTwoElements;
+		elementContainer* previousSuperParent = superParent;
+		
+		insertValue(values[j], destination, superParent, containerAssigner);
+		
+		if(superParent != previousSuperParent)
+			++depth;
+		if(isPromoting){
+			for(int k = j + 1;k < batchLength;++k){
+				if(destinations[k] == destination)
+					destinations[k] = findInsertLocForDepth(depth)(values[k], superParent);
+			}
+		}
+	}
+}
+
+
+//Nest levels below the superParent of a pyramid built by buildPyramid from length values: the deepest pyramid in which every container can hold an element
+int bulkDepth(int length){
+	int depth = 0;
+	while(((long)2 << (depth + 1)) - 1 <= length)	//a pyramid nested depth + 1 levels holds at least 2^(depth + 2) - 1 elements
+		++depth;
+	return depth;
+}
+
+//Build a pyramid nested level levels deep out of values, which are sorted from lowest to highest, and return its top container. Each container is
+	//taken from assignContainer(nest level), in order from the lowest to the highest values on each nest level, and the values are split between 
+	//nested containers as evenly as possible. Every value is placed once, so the pyramid is built in linear time rather than by inserting each value
+template<typename containerSource>
+elementContainer* buildPyramid(const int* values, int length, int level, containerSource& assignContainer){
+	elementContainer* container = assignContainer(level);
+	
+	if(level == 0){
+		container->nestedContainer = nullptr;
+		container->element0.val = values[0];
+		container->hasTwoElements = (length == 2);
+		if(length == 2)
+			container->element1.val = values[1];
+		recountValues(container);
+		return container;
+	}
+	
+	//a nested container holds up to 3^level - 1 values, use a second element when the first one's two nested containers can't hold the rest
+	long maxNestedLength = 1;
+	for(int i = 0;i < level;++i)
+		maxNestedLength *= 3;
+	--maxNestedLength;
+	container->hasTwoElements = (length - 1 > 2 * maxNestedLength);
+	
+	int nestedLengths[3] = {0, 0, 0};
+	if(container->hasTwoElements){
+		nestedLengths[0] = (length - 2) / 3;
+		nestedLengths[1] = (length - 2 - nestedLengths[0]) / 2;
+		nestedLengths[2] = length - 2 - nestedLengths[0] - nestedLengths[1];
+	}
+	else{
+		nestedLengths[0] = (length - 1) / 2;
+		nestedLengths[1] = length - 1 - nestedLengths[0];
+	}
+	
+	container->nestedContainer = buildPyramid(values, nestedLengths[0], level - 1, assignContainer);
+	container->nestedContainer->parentContainer = container;
+	values += nestedLengths[0];
+	
+	container->element0.val = values[0];
+	container->element0.nestedContainer = buildPyramid(values + 1, nestedLengths[1], level - 1, assignContainer);
+	container->element0.nestedContainer->parentContainer = container;
+	values += nestedLengths[1] + 1;
+	
+	if(container->hasTwoElements){
+		container->element1.val = values[0];
+		container->element1.nestedContainer = buildPyramid(values + 1, nestedLengths[2], level - 1, assignContainer);
+		container->element1.nestedContainer->parentContainer = container;
+	}
+	recountValues(container);
+	return container;
+}
+
+
 //Allocates memory for allContainers and allElements based on the array length
 void allocateMemory(int arrayLength, elementContainer*& allContainers){
 	allContainers = new elementContainer[arrayLength];
@@ -376,6 +559,10 @@ void deallocateMemory(elementContainer*& allContainers){
 	delete[] allContainers;
 	allContainers = nullptr;
 }
+//Bytes of memory allocated for allContainers based on the array length
+long containerMemoryBytes(int arrayLength){
+	return (long)arrayLength * sizeof(elementContainer);
+}
 
 
 //Sort an array
@@ -383,80 +570,120 @@ void pyramidSort(int *array, int arrayLength, elementContainer* containerMemory)
 	if(arrayLength <= 1)
 		return;
 	
-	elementContainer** containerAssigner = new elementContainer*[(int)(std::log2(arrayLength + 1))];
+	elementContainer** containerAssigner = new elementContainer*[(int)(std::log2(arrayLength + 1)) + 1];	//one for each nest level
 	int position = arrayLength;
 	for(int i = 0; i < std::log2(arrayLength + 1);++i){
 		position /= 2;
 		containerAssigner[i] = (containerMemory + position);
 	}
 
-	//assign parent elementContainer
-	elementContainer* superParent = containerAssigner[1]++;
+	//A sorted prefix is built into a pyramid directly, the rest of the elements are inserted into it
+	int sortedLength = 1;
+	while(sortedLength < arrayLength && array[sortedLength - 1] <= array[sortedLength])
+		++sortedLength;
+	if(sortedLength == arrayLength || arrayLength == 2){
+		if(sortedLength < arrayLength)
+			std::swap(array[0], array[1]);
+		delete[] containerAssigner;
+		return;
+	}
 	
-	//initialize the first three containers (superParent and its 2 children)
-	superParent->hasTwoElements = false;
-	superParent->parentContainer = nullptr;
-	superParent->nestedContainer = containerAssigner[0]++;
-	superParent->element0.nestedContainer = containerAssigner[0]++;
+	elementContainer* superParent;
+	int depth = 1;
+	int firstInserted = 3;
+	if(sortedLength >= minBulkLength){
+		depth = bulkDepth(sortedLength);
+		auto assignContainer = [containerAssigner](int level){ return containerAssigner[level]++; };
+		superParent = buildPyramid(array, sortedLength, depth, assignContainer);
+		superParent->parentContainer = nullptr;
+		firstInserted = sortedLength;
+	}
+	else{
+		//assign parent elementContainer
+		superParent = containerAssigner[1]++;
 	
-	superParent->nestedContainer->parentContainer = superParent;
-	superParent->nestedContainer->hasTwoElements = false;
+		//initialize the first three containers (superParent and its 2 children)
+		superParent->hasTwoElements = false;
+		superParent->parentContainer = nullptr;
+		superParent->nestedContainer = containerAssigner[0]++;
+		superParent->element0.nestedContainer = containerAssigner[0]++;
 	
-	superParent->element0.nestedContainer->parentContainer = superParent;
-	superParent->element0.nestedContainer->hasTwoElements = false;
+		superParent->nestedContainer->parentContainer = superParent;
+		superParent->nestedContainer->hasTwoElements = false;
 	
-	//Set the nested containers of both bottom containers to nullptr, as that is what is checked to determine if the bottom has been reached
-	superParent->nestedContainer->nestedContainer = nullptr;
-	superParent->element0.nestedContainer->nestedContainer = nullptr;
+		superParent->element0.nestedContainer->parentContainer = superParent;
+		superParent->element0.nestedContainer->hasTwoElements = false;
 	
+		//Set the nested containers of both bottom containers to nullptr, as that is what is checked to determine if the bottom has been reached
+		superParent->nestedContainer->nestedContainer = nullptr;
+		superParent->element0.nestedContainer->nestedContainer = nullptr;
 	
-	//Assign values to the correct locations in the initial containers
-	if(array[0] >= array[1]){
-		if(array[0] >= array[2]){
-			superParent->element0.nestedContainer->element0.val = array[0];
-			if(array[1] >= array[2]){
-				superParent->element0.val = array[1];
-				superParent->nestedContainer->element0.val = array[2];
+	
+		//Assign values to the correct locations in the initial containers
+		if(array[0] >= array[1]){
+			if(array[0] >= array[2]){
+				superParent->element0.nestedContainer->element0.val = array[0];
+				if(array[1] >= array[2]){
+					superParent->element0.val = array[1];
+					superParent->nestedContainer->element0.val = array[2];
+				}
+				else{
+					superParent->element0.val = array[2];
+					superParent->nestedContainer->element0.val = array[1];
+				}
 			}
 			else{
-				superParent->element0.val = array[2];
+				superParent->element0.nestedContainer->element0.val = array[2];
+				superParent->element0.val = array[0];
 				superParent->nestedContainer->element0.val = array[1];
 			}
 		}
 		else{
-			superParent->element0.nestedContainer->element0.val = array[2];
-			superParent->element0.val = array[0];
-			superParent->nestedContainer->element0.val = array[1];
-		}
-	}
-	else{
-		if(array[1] >= array[2]){
-			superParent->element0.nestedContainer->element0.val = array[1];
-			if(array[0] >= array[2]){
-				superParent->element0.val = array[0];
-				superParent->nestedContainer->element0.val = array[2];
+			if(array[1] >= array[2]){
+				superParent->element0.nestedContainer->element0.val = array[1];
+				if(array[0] >= array[2]){
+					superParent->element0.val = array[0];
+					superParent->nestedContainer->element0.val = array[2];
+				}
+				else{
+					superParent->element0.val = array[2];
+					superParent->nestedContainer->element0.val = array[0];
+				}
 			}
 			else{
-				superParent->element0.val = array[2];
+				superParent->element0.nestedContainer->element0.val = array[2];
+				superParent->element0.val = array[1];
 				superParent->nestedContainer->element0.val = array[0];
 			}
 		}
-		else{
-			superParent->element0.nestedContainer->element0.val = array[2];
-			superParent->element0.val = array[1];
-			superParent->nestedContainer->element0.val = array[0];
-		}
+	
+	
 	}
 	
 	
-	//Place the rest of the elements
-	for(int i = 3;i < arrayLength;++i){
-		elementContainer* destination = findInsertLoc(array[i],superParent);
-		insertValue(array[i], destination, superParent, containerAssigner);
+	//Place the rest of the elements. When a value's insertion promotes the superParent, there is one more nest level to go down
+	if(arrayLength < minBatchedArrayLength){
+		findInsertLocFunction findInsertLocAtDepth = findInsertLocForDepth(depth);
+		for(int i = firstInserted;i < arrayLength;++i){
+			elementContainer* previousSuperParent = superParent;
+			elementContainer* destination = findInsertLocAtDepth(array[i],superParent);
+			insertValue(array[i], destination, superParent, containerAssigner);
+			
+			if(superParent != previousSuperParent)
+				findInsertLocAtDepth = findInsertLocForDepth(++depth);
+		}
+	}
+	//Once the pyramid no longer fits in the cache, insert in batches so that cache misses overlap
+	else{
+		for(int i = firstInserted;i < arrayLength;i += insertBatchSize){
+			insertBatch(array + i, std::min(insertBatchSize, arrayLength - i), superParent, depth, containerAssigner);
+		}
 	}
 	
 	int index = 0;
 	placeElementsInArray(superParent, array, index);
+	
+	delete[] containerAssigner;
 }
 
 //sort an array
@@ -467,3 +694,1644 @@ void pyramidSort(int* array, int arrayLength){
 	deallocateMemory(allContainers);
 }
 
+
+
+/****************************************************************
+PYRAMID QUEUE****************************************************
+*****************************************************************
+-PyramidQueue keeps a pyramid alive as a priority queue. Pushing works like pyramidSort, with containers taken from a pool rather than a block sized for
+	the whole array. Until there are three elements, the superParent is a bottom container.
+-Containers come from the pool one at a time rather than from a region for each nest level, so promotions go through promoteAt instead of promote().
+	Like promote(), it puts the promoted element after the container it came from.
+-The lowest value is in the bottom container found by following nestedContainer down, and the highest in the bottom container found by following the
+	last element's nested container. Removing either is usually just removing an element from that container.
+-When the container has no elements left, it is demoted (the inverse of a promotion). If its neighbour has two elements, the neighbour's nearest element 
+	moves up to the parent and the parent's element between them moves down into the container. Otherwise the parent's element moves down and the
+	container is merged into the neighbour, which takes the parent one element lower, so the demotion may carry on up the pyramid. When the superParent 
+	is left without elements, its only nested container becomes the superParent.
+-Two pyramids are joined by taking the lowest value of the higher one as the element between them, and adding the shallower pyramid as the first 
+	or last nested container on the deeper one's nest level just above it, which may set off promotions. A pyramid is split along the path down to
+	the split point by joining what is left and right of the path on each nest level, from the bottom up. Both take time proportional to the depth
+	(splitAtRank also has to count the values before the split point, unless VALUE_COUNTS is defined), where rebuilding them would take time 
+	proportional to the number of values.
+-With VALUE_COUNTS defined, each container counts the values in it and its nested containers. A push or pop adds to or takes from the counts on its
+	way down, and the containers a promotion or demotion changes are counted again from their nested containers, so rank() and select() only go down 
+	one path. pyramidSort's promotions leave the counts alone, as its pyramids are never asked for a rank.
+*****************************************************************/
+
+
+const int queueChunkContainers = 256;	//Containers allocated at a time by PyramidPool
+const int maxQueueDepth = 40;	//Deeper than any pyramid of 2^31 elements
+
+
+PyramidPool::PyramidPool(){
+	freeContainers = nullptr;
+	chunksLength = 16;
+	chunks = new elementContainer*[chunksLength];
+	numChunks = 0;
+}
+
+PyramidPool::~PyramidPool(){
+	for(int i = 0;i < numChunks;++i){
+		delete[] chunks[i];
+	}
+	delete[] chunks;
+}
+
+//Get an unused container, allocating a chunk of them when there are none
+elementContainer* PyramidPool::acquire(){
+	if(freeContainers == nullptr){
+		if(numChunks == chunksLength){
+			elementContainer** grownChunks = new elementContainer*[2 * chunksLength];
+			memcpy(grownChunks, chunks, sizeof(elementContainer*) * numChunks);
+			delete[] chunks;
+			chunks = grownChunks;
+			chunksLength *= 2;
+		}
+		
+		elementContainer* chunk = new elementContainer[queueChunkContainers];
+		chunks[numChunks++] = chunk;
+		for(int i = queueChunkContainers - 1;i >= 0;--i){
+			chunk[i].parentContainer = freeContainers;
+			freeContainers = chunk + i;
+		}
+	}
+	
+	elementContainer* container = freeContainers;
+	freeContainers = container->parentContainer;
+	return container;
+}
+
+void PyramidPool::release(elementContainer* container){
+	container->parentContainer = freeContainers;
+	freeContainers = container;
+}
+
+long PyramidPool::reservedBytes() const{
+	return (long)numChunks * queueChunkContainers * sizeof(elementContainer);
+}
+
+void PyramidPool::adopt(PyramidPool& other){
+	for(int i = 0;i < other.numChunks;++i){
+		if(numChunks == chunksLength){
+			elementContainer** grownChunks = new elementContainer*[2 * chunksLength];
+			memcpy(grownChunks, chunks, sizeof(elementContainer*) * numChunks);
+			delete[] chunks;
+			chunks = grownChunks;
+			chunksLength *= 2;
+		}
+		chunks[numChunks++] = other.chunks[i];
+	}
+	other.numChunks = 0;
+	
+	while(other.freeContainers != nullptr){
+		elementContainer* container = other.freeContainers;
+		other.freeContainers = container->parentContainer;
+		release(container);
+	}
+}
+
+
+PyramidQueue::PyramidQueue(PyramidPool* pool){
+	superParent = nullptr;
+	depth = 0;
+	count = 0;
+	this->pool = (pool != nullptr) ? pool : &ownPool;
+}
+
+PyramidQueue::PyramidQueue(const int* values, int length, PyramidPool* pool) : PyramidQueue(pool){
+	if(length <= 0)
+		return;
+	
+	depth = bulkDepth(length);
+	count = length;
+	auto assignContainer = [this](int){ return this->pool->acquire(); };
+	superParent = buildPyramid(values, length, depth, assignContainer);
+	superParent->parentContainer = nullptr;
+}
+
+//A queue with its own pool frees its containers along with the pool, otherwise they go back to the shared pool
+PyramidQueue::~PyramidQueue(){
+	if(pool != &ownPool && superParent != nullptr)
+		releaseContainers(superParent, depth);
+}
+
+void PyramidQueue::releaseContainers(elementContainer* source, int level){
+	if(level > 0){
+		releaseContainers(source->nestedContainer, level - 1);
+		releaseContainers(source->element0.nestedContainer, level - 1);
+		if(source->hasTwoElements)
+			releaseContainers(source->element1.nestedContainer, level - 1);
+	}
+	pool->release(source);
+}
+
+
+//Count the values in source and its nested containers, stopping once there are more than limit
+int countValues(const elementContainer* source, int level, int limit){
+	int count = source->hasTwoElements ? 2 : 1;
+	if(level > 0){
+		count += countValues(source->nestedContainer, level - 1, limit - count);
+		if(count <= limit)
+			count += countValues(source->element0.nestedContainer, level - 1, limit - count);
+		if(count <= limit && source->hasTwoElements)
+			count += countValues(source->element1.nestedContainer, level - 1, limit - count);
+	}
+	return count;
+}
+
+int PyramidQueue::size() const{
+	if(count < 0)
+		count = countValues(superParent, depth, INT_MAX);
+	return count;
+}
+
+
+//Insert value into container at position (0 before element0, 1 after element0, 2 after element1), with nestedContainer holding the elements between 
+	//it and the next element. A full container is split: its middle element is promoted to the parent, at the position after the container.
+	//container is in the pyramid under top, which gets a new top container when the old one is split. The values inserted must already be counted in
+	//container and the containers above it
+void PyramidQueue::promoteAt(elementContainer* container, int position, int value, elementContainer* nestedContainer, elementContainer*& top, 
+								int& topDepth){
+	while(true){
+		
+		//no promotion, just insert
+		if(!container->hasTwoElements){
+			if(position == 0){
+				container->element1 = container->element0;
+				container->element0.val = value;
+				container->element0.nestedContainer = nestedContainer;
+			}
+			else{
+				container->element1.val = value;
+				container->element1.nestedContainer = nestedContainer;
+			}
+			container->hasTwoElements = true;
+			return;
+		}
+		
+		//line up the three elements in order, keep the lowest in the container and move the highest to a new container
+		element elements[3];
+		elements[position].val = value;
+		elements[position].nestedContainer = nestedContainer;
+		elements[position == 0 ? 1 : 0] = container->element0;
+		elements[position == 2 ? 1 : 2] = container->element1;
+		
+		elementContainer* newContainer = pool->acquire();
+		newContainer->hasTwoElements = false;
+		newContainer->element0 = elements[2];
+		newContainer->nestedContainer = nullptr;
+		if(nestedContainer != nullptr){	//above the bottom nest level
+			newContainer->nestedContainer = elements[1].nestedContainer;
+			newContainer->nestedContainer->parentContainer = newContainer;
+			newContainer->element0.nestedContainer->parentContainer = newContainer;
+		}
+		
+		container->element0 = elements[0];
+		container->hasTwoElements = false;
+		if(nestedContainer != nullptr)
+			container->element0.nestedContainer->parentContainer = container;	//the inserted element may have stayed in the container
+		recountValues(container);
+		recountValues(newContainer);
+		
+		//promote the middle element, creating a new superParent when there is no parent
+		elementContainer* parent = container->parentContainer;
+		if(parent == nullptr){
+			parent = pool->acquire();
+			parent->hasTwoElements = false;
+			parent->parentContainer = nullptr;
+			parent->nestedContainer = container;
+			parent->element0.val = elements[1].val;
+			parent->element0.nestedContainer = newContainer;
+			container->parentContainer = parent;
+			newContainer->parentContainer = parent;
+			recountValues(parent);
+			top = parent;
+			++topDepth;
+			return;
+		}
+		
+		newContainer->parentContainer = parent;
+		if(parent->nestedContainer == container)
+			position = 0;
+		else if(parent->element0.nestedContainer == container)
+			position = 1;
+		else
+			position = 2;
+		value = elements[1].val;
+		nestedContainer = newContainer;
+		container = parent;
+	}
+}
+
+
+void PyramidQueue::push(int value){
+	if(count >= 0)
+		++count;
+	
+	if(superParent == nullptr){
+		superParent = pool->acquire();
+		superParent->parentContainer = nullptr;
+		superParent->nestedContainer = nullptr;
+		superParent->hasTwoElements = false;
+		superParent->element0.val = value;
+		recountValues(superParent);
+		return;
+	}
+	
+	#ifdef VALUE_COUNTS
+	elementContainer* destination = superParent;
+	for(int level = depth;level > 0;--level){
+		addValueCount(destination, 1);
+		destination = nextContainer(value, destination);
+	}
+	addValueCount(destination, 1);
+	#else
+	elementContainer* destination = findInsertLocForDepth(depth)(value, superParent);
+	#endif
+	int position = 0;
+	if(value >= destination->element0.val)
+		position = (destination->hasTwoElements && value >= destination->element1.val) ? 2 : 1;
+	promoteAt(destination, position, value, nullptr, superParent, depth);
+}
+
+
+int PyramidQueue::min() const{
+	const elementContainer* container = superParent;
+	for(int level = depth;level > 0;--level)
+		container = container->nestedContainer;
+	return container->element0.val;
+}
+
+int PyramidQueue::max() const{
+	const elementContainer* container = superParent;
+	for(int level = depth;level > 0;--level)
+		container = container->hasTwoElements ? container->element1.nestedContainer : container->element0.nestedContainer;
+	return container->hasTwoElements ? container->element1.val : container->element0.val;
+}
+
+
+int PyramidQueue::popMin(){
+	elementContainer* container = superParent;
+	for(int level = depth;level > 0;--level){
+		addValueCount(container, -1);
+		container = container->nestedContainer;
+	}
+	addValueCount(container, -1);
+	
+	int value = container->element0.val;
+	if(count > 0)
+		--count;
+	
+	if(container->hasTwoElements){
+		container->element0.val = container->element1.val;
+		container->hasTwoElements = false;
+	}
+	else if(depth == 0){
+		pool->release(superParent);
+		superParent = nullptr;
+	}
+	else{
+		demoteFirst(container);
+	}
+	return value;
+}
+
+int PyramidQueue::popMax(){
+	elementContainer* container = superParent;
+	for(int level = depth;level > 0;--level){
+		addValueCount(container, -1);
+		container = container->hasTwoElements ? container->element1.nestedContainer : container->element0.nestedContainer;
+	}
+	addValueCount(container, -1);
+	
+	int value;
+	if(count > 0)
+		--count;
+	
+	if(container->hasTwoElements){
+		value = container->element1.val;
+		container->hasTwoElements = false;
+	}
+	else if(depth == 0){
+		value = container->element0.val;
+		pool->release(superParent);
+		superParent = nullptr;
+	}
+	else{
+		value = container->element0.val;
+		demoteLast(container);
+	}
+	return value;
+}
+
+
+//Demote a container with no elements that is the first nested container of its parent. An empty container still has its nestedContainer, 
+	//the one nested container it has left (nullptr on the bottom nest level)
+void PyramidQueue::demoteFirst(elementContainer* container){
+	while(true){
+		elementContainer* parent = container->parentContainer;
+		elementContainer* neighbour = parent->element0.nestedContainer;
+		elementContainer* onlyNestedContainer = container->nestedContainer;
+		bool isBottom = (onlyNestedContainer == nullptr);
+		
+		//move the parent's first element down into the container, and the neighbour's first element up to the parent
+		if(neighbour->hasTwoElements){
+			container->element0.val = parent->element0.val;
+			parent->element0.val = neighbour->element0.val;
+			if(!isBottom){
+				container->element0.nestedContainer = neighbour->nestedContainer;
+				container->element0.nestedContainer->parentContainer = container;
+				neighbour->nestedContainer = neighbour->element0.nestedContainer;
+			}
+			neighbour->element0 = neighbour->element1;
+			neighbour->hasTwoElements = false;
+			recountValues(container);
+			recountValues(neighbour);
+			return;
+		}
+		
+		//merge the container and the parent's first element into the neighbour
+		neighbour->element1 = neighbour->element0;
+		neighbour->element0.val = parent->element0.val;
+		neighbour->element0.nestedContainer = neighbour->nestedContainer;
+		neighbour->nestedContainer = onlyNestedContainer;
+		if(!isBottom)
+			onlyNestedContainer->parentContainer = neighbour;
+		neighbour->hasTwoElements = true;
+		recountValues(neighbour);
+		pool->release(container);
+		
+		parent->nestedContainer = neighbour;
+		if(parent->hasTwoElements){
+			parent->element0 = parent->element1;
+			parent->hasTwoElements = false;
+			return;
+		}
+		
+		//the parent has no elements left
+		if(parent->parentContainer == nullptr){
+			neighbour->parentContainer = nullptr;
+			superParent = neighbour;
+			pool->release(parent);
+			--depth;
+			return;
+		}
+		container = parent;
+	}
+}
+
+//Demote a container with no elements that is the last nested container of its parent
+void PyramidQueue::demoteLast(elementContainer* container){
+	while(true){
+		elementContainer* parent = container->parentContainer;
+		elementContainer* onlyNestedContainer = container->nestedContainer;
+		bool isBottom = (onlyNestedContainer == nullptr);
+		
+		//the neighbour comes before the container, and the parent's last element is between them
+		elementContainer* neighbour;
+		element* parentElement;
+		if(parent->hasTwoElements){
+			neighbour = parent->element0.nestedContainer;
+			parentElement = &parent->element1;
+		}
+		else{
+			neighbour = parent->nestedContainer;
+			parentElement = &parent->element0;
+		}
+		
+		//move the parent's last element down into the container, and the neighbour's last element up to the parent
+		if(neighbour->hasTwoElements){
+			container->element0.val = parentElement->val;
+			parentElement->val = neighbour->element1.val;
+			if(!isBottom){
+				container->element0.nestedContainer = onlyNestedContainer;
+				container->nestedContainer = neighbour->element1.nestedContainer;
+				container->nestedContainer->parentContainer = container;
+			}
+			neighbour->hasTwoElements = false;
+			recountValues(container);
+			recountValues(neighbour);
+			return;
+		}
+		
+		//merge the parent's last element and the container into the neighbour
+		neighbour->element1.val = parentElement->val;
+		neighbour->element1.nestedContainer = onlyNestedContainer;
+		if(!isBottom)
+			onlyNestedContainer->parentContainer = neighbour;
+		neighbour->hasTwoElements = true;
+		recountValues(neighbour);
+		pool->release(container);
+		
+		if(parent->hasTwoElements){
+			parent->hasTwoElements = false;
+			return;
+		}
+		
+		//the parent has no elements left
+		if(parent->parentContainer == nullptr){
+			neighbour->parentContainer = nullptr;
+			superParent = neighbour;
+			pool->release(parent);
+			--depth;
+			return;
+		}
+		container = parent;
+	}
+}
+
+
+//Place up to k values from source and its nested containers in values, from highest to lowest
+void PyramidQueue::placeGreatest(const elementContainer* source, int level, int k, int* values, int& index) const{
+	if(level == 0){
+		if(source->hasTwoElements && index < k)
+			values[index++] = source->element1.val;
+		if(index < k)
+			values[index++] = source->element0.val;
+		return;
+	}
+	
+	if(source->hasTwoElements){
+		placeGreatest(source->element1.nestedContainer, level - 1, k, values, index);
+		if(index < k)
+			values[index++] = source->element1.val;
+	}
+	if(index < k)
+		placeGreatest(source->element0.nestedContainer, level - 1, k, values, index);
+	if(index < k)
+		values[index++] = source->element0.val;
+	if(index < k)
+		placeGreatest(source->nestedContainer, level - 1, k, values, index);
+}
+
+int PyramidQueue::topK(int k, int* values) const{
+	int index = 0;
+	if(superParent != nullptr && k > 0)
+		placeGreatest(superParent, depth, k, values, index);
+	return index;
+}
+
+
+
+#ifdef VALUE_COUNTS
+//Go down to the first value of at least key, counting the values passed on the way
+int PyramidQueue::rank(int key) const{
+	if(superParent == nullptr)
+		return 0;
+	
+	int lowerValues = 0;
+	const elementContainer* container = superParent;
+	for(int level = depth;level > 0;--level){
+		if(container->element0.val < key){
+			lowerValues += container->nestedContainer->valueCount + 1;
+			if(container->hasTwoElements && container->element1.val < key){
+				lowerValues += container->element0.nestedContainer->valueCount + 1;
+				container = container->element1.nestedContainer;
+			}
+			else{
+				container = container->element0.nestedContainer;
+			}
+		}
+		else{
+			container = container->nestedContainer;
+		}
+	}
+	return lowerValues + (container->element0.val < key) + (container->hasTwoElements && container->element1.val < key);
+}
+
+//Go down to the nested container holding the value, skipping the nested containers and elements before it
+int PyramidQueue::select(int rank) const{
+	const elementContainer* container = superParent;
+	for(int level = depth;level > 0;--level){
+		if(rank < container->nestedContainer->valueCount){
+			container = container->nestedContainer;
+			continue;
+		}
+		rank -= container->nestedContainer->valueCount;
+		if(rank == 0)
+			return container->element0.val;
+		--rank;
+		
+		if(!container->hasTwoElements || rank < container->element0.nestedContainer->valueCount){
+			container = container->element0.nestedContainer;
+			continue;
+		}
+		rank -= container->element0.nestedContainer->valueCount;
+		if(rank == 0)
+			return container->element1.val;
+		--rank;
+		container = container->element1.nestedContainer;
+	}
+	return (rank == 0) ? container->element0.val : container->element1.val;
+}
+#endif
+
+//Join the pyramid under top, nested topDepth levels, with key and the pyramid under higherTop, whose values are all at least key (which is at least 
+	//all of top's values). Either pyramid can be empty (nullptr). The lower pyramid is joined to the higher one's first nested container on the same nest 
+	//level or the other way around, with key as the element between them, so it takes time proportional to the difference in depth
+void PyramidQueue::joinWithKey(elementContainer*& top, int& topDepth, int key, elementContainer* higherTop, int higherDepth){
+	if(top == nullptr && higherTop == nullptr){
+		top = pool->acquire();
+		top->parentContainer = nullptr;
+		top->nestedContainer = nullptr;
+		top->hasTwoElements = false;
+		top->element0.val = key;
+		recountValues(top);
+		topDepth = 0;
+		return;
+	}
+	
+	//key goes before all of higherTop's values
+	if(top == nullptr){
+		top = higherTop;
+		topDepth = higherDepth;
+		elementContainer* container = top;
+		for(int level = topDepth;level > 0;--level){
+			addValueCount(container, 1);
+			container = container->nestedContainer;
+		}
+		addValueCount(container, 1);
+		promoteAt(container, 0, key, nullptr, top, topDepth);
+		return;
+	}
+	
+	//key goes after all of top's values
+	if(higherTop == nullptr){
+		elementContainer* container = top;
+		for(int level = topDepth;level > 0;--level){
+			addValueCount(container, 1);
+			container = container->hasTwoElements ? container->element1.nestedContainer : container->element0.nestedContainer;
+		}
+		addValueCount(container, 1);
+		promoteAt(container, container->hasTwoElements ? 2 : 1, key, nullptr, top, topDepth);
+		return;
+	}
+	
+	if(topDepth == higherDepth){
+		elementContainer* newTop = pool->acquire();
+		newTop->parentContainer = nullptr;
+		newTop->hasTwoElements = false;
+		newTop->nestedContainer = top;
+		newTop->element0.val = key;
+		newTop->element0.nestedContainer = higherTop;
+		top->parentContainer = newTop;
+		higherTop->parentContainer = newTop;
+		recountValues(newTop);
+		top = newTop;
+		++topDepth;
+	}
+	//higherTop becomes the last nested container of the container one nest level above it on top's last nested containers
+	else if(topDepth > higherDepth){
+		elementContainer* container = top;
+		for(int level = topDepth;level > higherDepth + 1;--level){
+			addValueCount(container, higherTop->valueCount + 1);
+			container = container->hasTwoElements ? container->element1.nestedContainer : container->element0.nestedContainer;
+		}
+		addValueCount(container, higherTop->valueCount + 1);
+		higherTop->parentContainer = container;
+		promoteAt(container, container->hasTwoElements ? 2 : 1, key, higherTop, top, topDepth);
+	}
+	//top becomes the first nested container of the container one nest level above it on higherTop's first nested containers
+	else{
+		elementContainer* lowerTop = top;
+		int lowerDepth = topDepth;
+		top = higherTop;
+		topDepth = higherDepth;
+		
+		elementContainer* container = top;
+		for(int level = topDepth;level > lowerDepth + 1;--level){
+			addValueCount(container, lowerTop->valueCount + 1);
+			container = container->nestedContainer;
+		}
+		addValueCount(container, lowerTop->valueCount + 1);
+		elementContainer* firstContainer = container->nestedContainer;
+		container->nestedContainer = lowerTop;
+		lowerTop->parentContainer = container;
+		promoteAt(container, 0, key, firstContainer, top, topDepth);
+	}
+}
+
+//Move other's containers into this queue's pool if other has a pool of its own
+void PyramidQueue::takePool(PyramidQueue& other){
+	if(other.pool == &other.ownPool && pool != &other.ownPool)
+		pool->adopt(other.ownPool);
+}
+
+void PyramidQueue::join(PyramidQueue& higher){
+	if(higher.superParent == nullptr)
+		return;
+	
+	int key = higher.popMin();
+	bool isCounted = (count >= 0 && higher.count >= 0);
+	int joinedCount = count + higher.count + 1;
+	takePool(higher);
+	
+	joinWithKey(superParent, depth, key, higher.superParent, higher.depth);
+	count = isCounted ? joinedCount : -1;
+	
+	higher.superParent = nullptr;
+	higher.depth = 0;
+	higher.count = 0;
+}
+
+void PyramidQueue::merge(PyramidQueue& other){
+	if(other.superParent == nullptr)
+		return;
+	
+	if(superParent == nullptr || other.min() >= max()){
+		join(other);
+		return;
+	}
+	
+	//the other queue's values are all lower: join this queue's values onto them
+	if(other.max() <= min()){
+		int key = popMin();
+		bool isCounted = (count >= 0 && other.count >= 0);
+		int joinedCount = count + other.count + 1;
+		takePool(other);
+		
+		elementContainer* lowerTop = other.superParent;
+		int lowerDepth = other.depth;
+		joinWithKey(lowerTop, lowerDepth, key, superParent, depth);
+		superParent = lowerTop;
+		depth = lowerDepth;
+		count = isCounted ? joinedCount : -1;
+		
+		other.superParent = nullptr;
+		other.depth = 0;
+		other.count = 0;
+		return;
+	}
+	
+	//the values overlap: merge them in order and build a new pyramid
+	int length = size();
+	int otherLength = other.size();
+	int* values = new int[length + otherLength];
+	int* mergedValues = new int[length + otherLength];
+	int index = 0;
+	placeElementsInArray(superParent, values, index);
+	placeElementsInArray(other.superParent, values, index);
+	std::merge(values, values + length, values + length, values + length + otherLength, mergedValues);
+	
+	releaseContainers(superParent, depth);
+	other.releaseContainers(other.superParent, other.depth);
+	takePool(other);
+	other.superParent = nullptr;
+	other.depth = 0;
+	other.count = 0;
+	
+	count = length + otherLength;
+	depth = bulkDepth(count);
+	auto assignContainer = [this](int){ return pool->acquire(); };
+	superParent = buildPyramid(mergedValues, count, depth, assignContainer);
+	superParent->parentContainer = nullptr;
+	
+	delete[] values;
+	delete[] mergedValues;
+}
+
+
+//Split the pyramid along a path, given by the position of the nested container the split goes through on each nest level and the number of values 
+	//of the bottom container that are kept. Everything before the path stays in this queue and everything after it goes to higher: on each nest level
+	//from the bottom up, the nested containers before the path are joined to the lower pyramid with the elements between them, and the ones after it
+	//to the higher pyramid. Each join takes time proportional to the difference in depth, so the split takes time proportional to the depth
+void PyramidQueue::split(const int* nestedPosition, int bottomLength, PyramidQueue& higher){
+	elementContainer* path[maxQueueDepth + 1];
+	path[depth] = superParent;
+	for(int level = depth;level > 0;--level){
+		elementContainer* container = path[level];
+		path[level - 1] = (nestedPosition[level] == 0) ? container->nestedContainer :
+							(nestedPosition[level] == 1) ? container->element0.nestedContainer : container->element1.nestedContainer;
+	}
+	
+	//split the bottom container
+	elementContainer* lowerTop = nullptr;
+	int lowerDepth = 0;
+	elementContainer* higherTop = nullptr;
+	int higherDepth = 0;
+	
+	elementContainer* bottom = path[0];
+	bottom->parentContainer = nullptr;
+	int bottomValues = bottom->hasTwoElements ? 2 : 1;
+	if(bottomLength == 0){
+		higherTop = bottom;
+	}
+	else{
+		lowerTop = bottom;
+		bottom->hasTwoElements = (bottomLength == 2);
+		if(bottomLength < bottomValues){
+			higherTop = pool->acquire();
+			higherTop->parentContainer = nullptr;
+			higherTop->nestedContainer = nullptr;
+			higherTop->hasTwoElements = false;
+			higherTop->element0.val = bottom->element1.val;
+		}
+	}
+	if(lowerTop != nullptr)
+		recountValues(lowerTop);
+	if(higherTop != nullptr)
+		recountValues(higherTop);
+	
+	for(int level = 1;level <= depth;++level){
+		elementContainer* container = path[level];
+		elementContainer* nestedContainers[3] = {container->nestedContainer, container->element0.nestedContainer, container->element1.nestedContainer};
+		int elements[2] = {container->element0.val, container->element1.val};
+		int numElements = container->hasTwoElements ? 2 : 1;
+		int position = nestedPosition[level];
+		
+		for(int i = position - 1;i >= 0;--i){
+			elementContainer* nestedTop = nestedContainers[i];
+			int nestedDepth = level - 1;
+			nestedTop->parentContainer = nullptr;
+			joinWithKey(nestedTop, nestedDepth, elements[i], lowerTop, lowerDepth);
+			lowerTop = nestedTop;
+			lowerDepth = nestedDepth;
+		}
+		for(int i = position;i < numElements;++i){
+			nestedContainers[i + 1]->parentContainer = nullptr;
+			joinWithKey(higherTop, higherDepth, elements[i], nestedContainers[i + 1], level - 1);
+		}
+		pool->release(container);
+	}
+	
+	superParent = lowerTop;
+	depth = lowerDepth;
+	higher.superParent = higherTop;
+	higher.depth = higherDepth;
+}
+
+void PyramidQueue::splitAtKey(int key, PyramidQueue& higher){
+	if(superParent == nullptr)
+		return;
+	
+	//go down to the first value of at least key, passing the elements lower than key
+	int nestedPosition[maxQueueDepth + 1];
+	elementContainer* container = superParent;
+	for(int level = depth;level > 0;--level){
+		nestedPosition[level] = (container->element0.val < key) + (container->hasTwoElements && container->element1.val < key);
+		container = (nestedPosition[level] == 0) ? container->nestedContainer :
+					(nestedPosition[level] == 1) ? container->element0.nestedContainer : container->element1.nestedContainer;
+	}
+	int bottomLength = (container->element0.val < key) + (container->hasTwoElements && container->element1.val < key);
+	
+	split(nestedPosition, bottomLength, higher);
+	#ifdef VALUE_COUNTS
+	count = (superParent == nullptr) ? 0 : superParent->valueCount;
+	higher.count = (higher.superParent == nullptr) ? 0 : higher.superParent->valueCount;
+	#else
+	count = (superParent == nullptr) ? 0 : -1;
+	higher.count = (higher.superParent == nullptr) ? 0 : -1;
+	#endif
+}
+
+//Without VALUE_COUNTS, finding where the split goes means counting the values before it
+void PyramidQueue::splitAtRank(int rank, PyramidQueue& higher){
+	int length = size();
+	rank = std::max(rank, 0);
+	if(rank >= length)
+		return;
+	int keptCount = rank;
+	
+	int nestedPosition[maxQueueDepth + 1];
+	elementContainer* container = superParent;
+	for(int level = depth;level > 0;--level){
+		elementContainer* nestedContainers[3] = {container->nestedContainer, container->element0.nestedContainer, container->element1.nestedContainer};
+		int numElements = container->hasTwoElements ? 2 : 1;
+		int position = 0;
+		while(true){
+			#ifdef VALUE_COUNTS
+			int nestedCount = nestedContainers[position]->valueCount;
+			#else
+			int nestedCount = countValues(nestedContainers[position], level - 1, rank);
+			#endif
+			if(rank <= nestedCount || position == numElements)
+				break;
+			rank -= nestedCount + 1;
+			++position;
+		}
+		nestedPosition[level] = position;
+		container = nestedContainers[position];
+	}
+	
+	split(nestedPosition, rank, higher);
+	count = keptCount;
+	higher.count = length - keptCount;
+}
+
+
+
+
+/****************************************************************
+WIDE PYRAMID SORT************************************************
+*****************************************************************
+-Wide pyramid sort follows the suggestion above of holding more elements per container: each container holds up to maxElements elements (a template
+	parameter) instead of 1 or 2. The pyramid is shallower and promotions happen less often, at the cost of a search inside each container.
+-The search inside a container counts the elements less than or equal to the value, comparing against every slot and masking out the unused ones. It has
+	no branches and a fixed length, so the compiler unrolls (and where it can, vectorizes) it.
+-A container's nested containers are kept in one array: nestedContainers[0] holds the elements before the first element (like nestedContainer in
+	elementContainer) and nestedContainers[i + 1] holds the elements after element i.
+-When a full container gets another element, its middle element is promoted to the parent and the elements after it are moved to a new container, 
+	so every container besides the superParent holds at least maxElements / 2 elements.
+*****************************************************************/
+
+
+template<int maxElements>
+struct wideContainer{
+	wideContainer* parentContainer;
+	int numElements;
+	int val[maxElements];
+	wideContainer* nestedContainers[maxElements + 1];	//all nullptr on the bottom nest level
+};
+
+
+//Number of elements in the container less than or equal to the value, which is the index of the nested container the value belongs in
+template<int maxElements>
+int countLessOrEqual(const wideContainer<maxElements>* container, int value){
+	int count = 0;
+	for(int i = 0;i < maxElements;++i)
+		count += (i < container->numElements) & (value >= container->val[i]);
+	return count;
+}
+
+
+//Insert an element at position, with the nested container that holds the elements after it
+template<int maxElements>
+void insertIntoContainer(wideContainer<maxElements>* container, int position, int value, wideContainer<maxElements>* nestedContainer){
+	memmove(container->val + position + 1, container->val + position, sizeof(int) * (container->numElements - position));
+	memmove(container->nestedContainers + position + 2, container->nestedContainers + position + 1, 
+		sizeof(wideContainer<maxElements>*) * (container->numElements - position));
+	container->val[position] = value;
+	container->nestedContainers[position + 1] = nestedContainer;
+	++container->numElements;
+}
+
+
+//Insert an element at position in a full container by promoting its middle element and moving the elements after the middle element to a new 
+	//container. The promoted element is then inserted into the parent container, which may trigger another promotion
+template<int maxElements>
+void widePromote(wideContainer<maxElements>* container, int position, int value, wideContainer<maxElements>* nestedContainer, int level,
+					wideContainer<maxElements>*& superParent, wideContainer<maxElements>** containerAssigner){
+	
+	//Put all maxElements + 1 elements in order, then split them around the middle element
+	int allVals[maxElements + 1];
+	wideContainer<maxElements>* allNestedContainers[maxElements + 2];
+	memcpy(allVals, container->val, sizeof(int) * position);
+	memcpy(allVals + position + 1, container->val + position, sizeof(int) * (maxElements - position));
+	allVals[position] = value;
+	memcpy(allNestedContainers, container->nestedContainers, sizeof(wideContainer<maxElements>*) * (position + 1));
+	memcpy(allNestedContainers + position + 2, container->nestedContainers + position + 1, sizeof(wideContainer<maxElements>*) * (maxElements - position));
+	allNestedContainers[position + 1] = nestedContainer;
+	
+	const int middle = maxElements / 2;
+	
+	wideContainer<maxElements>* newContainer = containerAssigner[level]++;
+	newContainer->numElements = maxElements - middle;
+	memcpy(newContainer->val, allVals + middle + 1, sizeof(int) * (maxElements - middle));
+	memcpy(newContainer->nestedContainers, allNestedContainers + middle + 1, sizeof(wideContainer<maxElements>*) * (maxElements - middle + 1));
+	if(level > 0){
+		for(int i = 0;i <= newContainer->numElements;++i)
+			newContainer->nestedContainers[i]->parentContainer = newContainer;
+	}
+	
+	container->numElements = middle;
+	memcpy(container->val, allVals, sizeof(int) * middle);
+	memcpy(container->nestedContainers, allNestedContainers, sizeof(wideContainer<maxElements>*) * (middle + 1));
+	
+	
+	//when there is no parent, create a new super parent with the promoted element
+	wideContainer<maxElements>* parent = container->parentContainer;
+	if(parent == nullptr){
+		wideContainer<maxElements>* newSuperParent = containerAssigner[level + 1]++;
+		newSuperParent->parentContainer = nullptr;
+		newSuperParent->numElements = 1;
+		newSuperParent->val[0] = allVals[middle];
+		newSuperParent->nestedContainers[0] = container;
+		newSuperParent->nestedContainers[1] = newContainer;
+		
+		container->parentContainer = newSuperParent;
+		newContainer->parentContainer = newSuperParent;
+		superParent = newSuperParent;
+		return;
+	}
+	
+	//the promoted element goes directly after the container's position in the parent
+	newContainer->parentContainer = parent;
+	int parentPosition = 0;
+	while(parent->nestedContainers[parentPosition] != container)
+		++parentPosition;
+	
+	if(parent->numElements < maxElements)
+		insertIntoContainer(parent, parentPosition, allVals[middle], newContainer);
+	else
+		widePromote(parent, parentPosition, allVals[middle], newContainer, level + 1, superParent, containerAssigner);
+}
+
+
+//Extract the elements from their nested wideContainers and put them in the correct, sorted order into a standard array
+template<int maxElements>
+void placeElementsInArray(const wideContainer<maxElements>* source, int* array, int& index){
+	if(source->nestedContainers[0] != nullptr){
+		for(int i = 0;i < source->numElements;++i){
+			placeElementsInArray(source->nestedContainers[i], array, index);
+			array[index] = source->val[i];
+			++index;
+		}
+		placeElementsInArray(source->nestedContainers[source->numElements], array, index);
+	}
+	else{
+		memcpy(array + index, source->val, sizeof(int) * source->numElements);
+		index += source->numElements;
+	}
+}
+
+
+//The most containers on each nest level of a wide pyramid of arrayLength elements. Every container besides the superParent holds at least 
+	//maxElements / 2 elements, so each one has a least subtreeElements elements in it and its nested containers, and the containers on a nest level 
+	//don't share any. Returns the number of nest levels
+template<int maxElements>
+int wideContainersPerLevel(int arrayLength, int* containers){
+	const long minElements = maxElements / 2;
+	long subtreeElements = minElements;
+	int levels = 0;
+	do{
+		containers[levels] = 1 + arrayLength / subtreeElements;	//1 for the superParent
+		subtreeElements = (minElements + 1) * subtreeElements + minElements;
+		++levels;
+	} while(containers[levels - 1] > 1);
+	return levels;
+}
+
+//Most containers used to sort arrayLength elements
+template<int maxElements>
+int wideContainersNeeded(int arrayLength){
+	int containers[64];
+	int levels = wideContainersPerLevel<maxElements>(arrayLength, containers);
+	int total = 0;
+	for(int i = 0;i < levels;++i)
+		total += containers[i];
+	return total;
+}
+
+
+//Sort an array with containers of up to maxElements elements, using containerMemory of at least wideContainersNeeded<maxElements>(arrayLength)
+template<int maxElements>
+void widePyramidSort(int* array, int arrayLength, wideContainer<maxElements>* containerMemory){
+	static_assert(maxElements >= 2, "a container must be able to hold two elements to promote one of them");
+	if(arrayLength <= 1)
+		return;
+	
+	//Each nest level is assigned containers from its own part of containerMemory, like in pyramidSort
+	int containers[64];
+	int levels = wideContainersPerLevel<maxElements>(arrayLength, containers);
+	wideContainer<maxElements>* containerAssigner[64];
+	int position = 0;
+	for(int i = levels - 1;i >= 0;--i){
+		containerAssigner[i] = containerMemory + position;
+		position += containers[i];
+	}
+	
+	//The super parent starts out as an empty container on the bottom nest level
+	wideContainer<maxElements>* superParent = containerAssigner[0]++;
+	superParent->parentContainer = nullptr;
+	superParent->numElements = 0;
+	superParent->nestedContainers[0] = nullptr;
+	int depth = 0;
+	
+	for(int i = 0;i < arrayLength;++i){
+		int value = array[i];
+		
+		wideContainer<maxElements>* destination = superParent;
+		for(int level = depth;level > 0;--level)
+			destination = destination->nestedContainers[countLessOrEqual(destination, value)];
+		
+		int position = countLessOrEqual(destination, value);
+		if(destination->numElements < maxElements){
+			insertIntoContainer(destination, position, value, (wideContainer<maxElements>*)nullptr);
+		}
+		else{
+			wideContainer<maxElements>* previousSuperParent = superParent;
+			widePromote(destination, position, value, (wideContainer<maxElements>*)nullptr, 0, superParent, containerAssigner);
+			if(superParent != previousSuperParent)
+				++depth;
+		}
+	}
+	
+	int index = 0;
+	placeElementsInArray(superParent, array, index);
+}
+
+//Sort an array with containers of up to maxElements elements
+template<int maxElements>
+void widePyramidSort(int* array, int arrayLength){
+	wideContainer<maxElements>* allContainers = new wideContainer<maxElements>[wideContainersNeeded<maxElements>(arrayLength)];
+	widePyramidSort(array, arrayLength, allContainers);
+	delete[] allContainers;
+}
+
+//Bytes of memory taken by the containers used to sort arrayLength elements
+template<int maxElements>
+long wideContainerMemoryBytes(int arrayLength){
+	return (long)wideContainersNeeded<maxElements>(arrayLength) * sizeof(wideContainer<maxElements>);
+}
+
+
+//The container sizes declared in pyramid-sort.h
+#define instantiateWidePyramidSort(maxElements) \
+	template void widePyramidSort<maxElements>(int* array, int arrayLength); \
+	template void widePyramidSort<maxElements>(int* array, int arrayLength, wideContainer<maxElements>* containerMemory); \
+	template int wideContainersNeeded<maxElements>(int arrayLength); \
+	template long wideContainerMemoryBytes<maxElements>(int arrayLength);
+instantiateWidePyramidSort(2)
+instantiateWidePyramidSort(4)
+instantiateWidePyramidSort(8)
+instantiateWidePyramidSort(16)
+instantiateWidePyramidSort(32)
+
+
+//Sort an array, with the container size that measured fastest for its length
+void widePyramidSort(int* array, int arrayLength){
+	if(arrayLength < 2000)
+		pyramidSort(array, arrayLength);
+	else
+		widePyramidSort<16>(array, arrayLength);
+}
+
+
+
+/****************************************************************
+COMPACT PYRAMID SORT*********************************************
+*****************************************************************
+-Compact pyramid sort builds the same pyramid as pyramidSort with a smaller container: the two values and three 32 bit indices of nested containers into 
+	the container memory, with hasTwoElements folded into the highest bit of the first index. That is 20 bytes per container instead of 48, so 3 
+	containers fit in a cache line and 10^8 elements take 2GB of containers instead of 4.8GB.
+-There is no parent container. Instead the containers passed on the way down are kept in a path, and promotions go back up the path.
+-Index 0 is never assigned, and means there is no nested container (as nullptr does in elementContainer).
+*****************************************************************/
+
+
+struct compactContainer{
+	int val0;
+	int val1;
+	unsigned int nestedContainer;	//the container of elements before val0, with the highest bit set when the container holds val1 as well
+	unsigned int nestedContainer0;	//the container of elements from val0 up to val1
+	unsigned int nestedContainer1;	//the container of elements from val1 up
+};
+
+const unsigned int hasTwoElementsBit = 0x80000000u;
+
+
+//Insert a value, along with the nested container of the elements after it, into the bottom container of the path. When a container is full, its
+	//middle value is promoted to the next container up the path, with a new container holding the highest value
+void compactInsertValue(int value, compactContainer* containers, unsigned int* path, int& depth, unsigned int* containerAssigner){
+	unsigned int newNestedContainer = 0;
+	
+	for(int level = 0;;++level){
+		compactContainer* destination = containers + path[level];
+		
+		//no promotion, just insert
+		if(!(destination->nestedContainer & hasTwoElementsBit)){
+			if(value >= destination->val0){
+				destination->val1 = value;
+				destination->nestedContainer1 = newNestedContainer;
+			}
+			else{
+				destination->val1 = destination->val0;
+				destination->nestedContainer1 = destination->nestedContainer0;
+				destination->val0 = value;
+				destination->nestedContainer0 = newNestedContainer;
+			}
+			destination->nestedContainer |= hasTwoElementsBit;
+			return;
+		}
+		
+		//the destination is full, put the three values in order, keep the lowest in the destination, move the highest to a new container and
+			//promote the middle one
+		int lowValue, middleValue, highValue;
+		unsigned int nested0, nested1, nested2;	//the nested containers after each of the three values
+		if(value >= destination->val0){
+			lowValue = destination->val0;
+			nested0 = destination->nestedContainer0;
+			if(value >= destination->val1){
+				middleValue = destination->val1;
+				nested1 = destination->nestedContainer1;
+				highValue = value;
+				nested2 = newNestedContainer;
+			}
+			else{
+				middleValue = value;
+				nested1 = newNestedContainer;
+				highValue = destination->val1;
+				nested2 = destination->nestedContainer1;
+			}
+		}
+		else{
+			lowValue = value;
+			nested0 = newNestedContainer;
+			middleValue = destination->val0;
+			nested1 = destination->nestedContainer0;
+			highValue = destination->val1;
+			nested2 = destination->nestedContainer1;
+		}
+		
+		unsigned int newContainerIndex = containerAssigner[level]++;
+		compactContainer* newContainer = containers + newContainerIndex;
+		newContainer->val0 = highValue;
+		newContainer->nestedContainer = nested1;
+		newContainer->nestedContainer0 = nested2;
+		
+		destination->val0 = lowValue;
+		destination->nestedContainer &= ~hasTwoElementsBit;
+		destination->nestedContainer0 = nested0;
+		
+		value = middleValue;
+		newNestedContainer = newContainerIndex;
+		
+		//when there is no parent, create a new super parent
+		if(level == depth){
+			unsigned int newSuperParentIndex = containerAssigner[level + 1]++;
+			compactContainer* newSuperParent = containers + newSuperParentIndex;
+			newSuperParent->val0 = value;
+			newSuperParent->nestedContainer = path[level];
+			newSuperParent->nestedContainer0 = newNestedContainer;
+			
+			path[level + 1] = newSuperParentIndex;
+			++depth;
+			return;
+		}
+	}
+}
+
+
+//Extract the elements from their nested compactContainers and put them in the correct, sorted order into a standard array
+void placeElementsInArray(const compactContainer* containers, unsigned int source, int level, int* array, int& index){
+	const compactContainer* container = containers + source;
+	bool hasTwoElements = container->nestedContainer & hasTwoElementsBit;
+	
+	if(level > 0){
+		placeElementsInArray(containers, container->nestedContainer & ~hasTwoElementsBit, level - 1, array, index);
+		array[index++] = container->val0;
+		placeElementsInArray(containers, container->nestedContainer0, level - 1, array, index);
+		if(hasTwoElements){
+			array[index++] = container->val1;
+			placeElementsInArray(containers, container->nestedContainer1, level - 1, array, index);
+		}
+	}
+	else{
+		array[index++] = container->val0;
+		if(hasTwoElements)
+			array[index++] = container->val1;
+	}
+}
+
+
+//Containers used to sort arrayLength elements: one for each element at most, and the unused index 0
+long compactContainersNeeded(int arrayLength){
+	return (long)arrayLength + 1;
+}
+
+
+//Sort an array using containerMemory of at least compactContainersNeeded(arrayLength) containers
+void compactPyramidSort(int* array, int arrayLength, compactContainer* containerMemory){
+	if(arrayLength <= 1)
+		return;
+	
+	//Each nest level is assigned containers from its own part of containerMemory, like in pyramidSort. A pyramid of n elements has at most 
+		//(n + 1) / 2^(level + 1) containers on each level counting up from the bottom, which adds up to less than n + 1
+	unsigned int containerAssigner[64];
+	long position = compactContainersNeeded(arrayLength);
+	for(int level = 0;(compactContainersNeeded(arrayLength) >> (level + 1)) > 0;++level){
+		position -= compactContainersNeeded(arrayLength) >> (level + 1);
+		containerAssigner[level] = position;
+	}
+	
+	//The super parent starts out as a container on the bottom nest level holding the first element
+	unsigned int path[64];	//the containers on the way down from the super parent, path[level] is the container on that nest level
+	int depth = 0;
+	unsigned int superParent = containerAssigner[0]++;
+	containerMemory[superParent].val0 = array[0];
+	containerMemory[superParent].nestedContainer = 0;
+	containerMemory[superParent].nestedContainer0 = 0;
+	
+	for(int i = 1;i < arrayLength;++i){
+		int value = array[i];
+		
+		unsigned int destination = superParent;
+		for(int level = depth;level > 0;--level){
+			path[level] = destination;
+			const compactContainer* container = containerMemory + destination;
+			if(value >= container->val0){
+				if((container->nestedContainer & hasTwoElementsBit) && value >= container->val1)
+					destination = container->nestedContainer1;
+				else
+					destination = container->nestedContainer0;
+			}
+			else{
+				destination = container->nestedContainer & ~hasTwoElementsBit;
+			}
+		}
+		path[0] = destination;
+		
+		compactInsertValue(value, containerMemory, path, depth, containerAssigner);
+		superParent = path[depth];
+	}
+	
+	int index = 0;
+	placeElementsInArray(containerMemory, superParent, depth, array, index);
+}
+
+//Sort an array using the compact container layout
+void compactPyramidSort(int* array, int arrayLength){
+	compactContainer* allContainers = new compactContainer[compactContainersNeeded(arrayLength)];
+	compactPyramidSort(array, arrayLength, allContainers);
+	delete[] allContainers;
+}
+
+
+
+
+/****************************************************************
+SNAPSHOT PYRAMID*************************************************
+*****************************************************************
+-SnapshotPyramid has one writer inserting values and any number of readers scanning snapshots of it at the same time. It uses containers like
+	compactPyramidSort's, with the version that made each one. Inserted values are seen by snapshots once the writer publishes them.
+-A published version must not change, so the writer copies a container before changing it when an earlier version made it (copy on write): the
+	containers on the way down are copied, from the superParent down, into the version being built. Containers the version being built made are 
+	changed in place, so between two publishes each container is copied at most once, and publishing rarely keeps the copying low.
+-A copied container is retired along with the last version that may use it. Each reader holds a slot with the version its snapshot is of, and when
+	the writer publishes, it reuses the retired containers of versions older than any slot holds. The writer never waits for readers: containers
+	a reader may still reach just stay retired until the next publish after it is done.
+-The published version is read with a sequence lock, and a reader checks that it is still the published version after filling its slot. Otherwise 
+	the writer may have published a newer version and reused containers before seeing the slot, so the reader starts over.
+-Containers are found by index in chunks that are never moved, so readers can follow indices while the writer allocates new chunks.
+*****************************************************************/
+
+
+struct snapshotContainer{
+	int val0;
+	int val1;
+	unsigned int nestedContainer;	//the container of elements before val0, with hasTwoElementsBit set when the container holds val1 as well
+	unsigned int nestedContainer0;	//the container of elements from val0 up to val1
+	unsigned int nestedContainer1;	//the container of elements from val1 up
+	unsigned long version;	//The version being built when the container was made
+};
+
+const int snapshotChunkBits = 16;	//Containers in a chunk, as a power of 2
+const unsigned int snapshotChunkMask = (1u << snapshotChunkBits) - 1;
+const int maxSnapshotChunks = 1 << (32 - snapshotChunkBits);
+const unsigned long claimedSlot = ~0ul;	//A reader slot taken by a snapshot that doesn't hold a version yet
+
+
+SnapshotPyramid::SnapshotPyramid(){
+	//version 1 is the empty pyramid
+	publishSequence.store(0);
+	publishedVersion.store(1);
+	publishedSuperParent.store(0);
+	publishedDepth.store(0);
+	publishedCount.store(0);
+	for(int i = 0;i < maxReaders;++i){
+		readers[i].version.store(0);
+	}
+	
+	buildingVersion = 2;
+	superParent = 0;
+	depth = 0;
+	count = 0;
+	
+	chunks = new snapshotContainer*[maxSnapshotChunks]();
+	chunks[0] = new snapshotContainer[1 << snapshotChunkBits];
+	nextContainer = 1;	//index 0 means no container
+	freeContainers = 0;
+	
+	retiredLength = 1024;
+	retiredContainers = new unsigned int[retiredLength];
+	retiredVersions = new unsigned long[retiredLength];
+	retiredStart = 0;
+	retiredEnd = 0;
+}
+
+SnapshotPyramid::~SnapshotPyramid(){
+	for(int i = 0;i < maxSnapshotChunks && chunks[i] != nullptr;++i){
+		delete[] chunks[i];
+	}
+	delete[] chunks;
+	delete[] retiredContainers;
+	delete[] retiredVersions;
+}
+
+
+snapshotContainer* SnapshotPyramid::container(unsigned int index) const{
+	return chunks[index >> snapshotChunkBits] + (index & snapshotChunkMask);
+}
+
+//Get an unused container for the version being built
+unsigned int SnapshotPyramid::newContainer(){
+	unsigned int index;
+	if(freeContainers != 0){
+		index = freeContainers;
+		freeContainers = container(index)->nestedContainer0;
+	}
+	else{
+		index = nextContainer++;
+		if(chunks[index >> snapshotChunkBits] == nullptr)
+			chunks[index >> snapshotChunkBits] = new snapshotContainer[1 << snapshotChunkBits];
+	}
+	container(index)->version = buildingVersion;
+	return index;
+}
+
+//A container of the version being built to change in place of the one at index, which is copied if an earlier version made it
+unsigned int SnapshotPyramid::writableContainer(unsigned int index){
+	if(container(index)->version == buildingVersion)
+		return index;
+	
+	unsigned int copy = newContainer();
+	*container(copy) = *container(index);
+	container(copy)->version = buildingVersion;
+	retire(index);
+	return copy;
+}
+
+//Keep a container replaced by a copy until no snapshot can reach it. The last version that may use it is the last one published
+void SnapshotPyramid::retire(unsigned int index){
+	if(retiredEnd == retiredLength){
+		int numRetired = retiredEnd - retiredStart;
+		if(numRetired > retiredLength / 2){
+			unsigned int* grownContainers = new unsigned int[2 * retiredLength];
+			unsigned long* grownVersions = new unsigned long[2 * retiredLength];
+			memcpy(grownContainers, retiredContainers + retiredStart, sizeof(unsigned int) * numRetired);
+			memcpy(grownVersions, retiredVersions + retiredStart, sizeof(unsigned long) * numRetired);
+			delete[] retiredContainers;
+			delete[] retiredVersions;
+			retiredContainers = grownContainers;
+			retiredVersions = grownVersions;
+			retiredLength *= 2;
+		}
+		else{
+			memmove(retiredContainers, retiredContainers + retiredStart, sizeof(unsigned int) * numRetired);
+			memmove(retiredVersions, retiredVersions + retiredStart, sizeof(unsigned long) * numRetired);
+		}
+		retiredStart = 0;
+		retiredEnd = numRetired;
+	}
+	
+	retiredContainers[retiredEnd] = index;
+	retiredVersions[retiredEnd] = buildingVersion - 1;
+	++retiredEnd;
+}
+
+
+void SnapshotPyramid::insert(int value){
+	++count;
+	
+	if(superParent == 0){
+		superParent = newContainer();
+		snapshotContainer* bottom = container(superParent);
+		bottom->val0 = value;
+		bottom->nestedContainer = 0;
+		bottom->nestedContainer0 = 0;
+		depth = 0;
+		return;
+	}
+	
+	//go down to the bottom, making each container on the way writable. A copied container replaces the original in its (already writable) parent
+	unsigned int path[maxDepth + 1];	//path[level] is the container on that nest level
+	int nestedPosition[maxDepth + 1];	//the nested container taken on each nest level: 0 before val0, 1 after val0, 2 after val1
+	superParent = writableContainer(superParent);
+	path[depth] = superParent;
+	for(int level = depth;level > 0;--level){
+		snapshotContainer* parent = container(path[level]);
+		bool hasTwoElements = parent->nestedContainer & hasTwoElementsBit;
+		int position = (value >= parent->val0) + (hasTwoElements && value >= parent->val1);
+		unsigned int* nestedIndex = (position == 0) ? &parent->nestedContainer : (position == 1) ? &parent->nestedContainer0 : &parent->nestedContainer1;
+		
+		unsigned int nested = *nestedIndex & ~hasTwoElementsBit;
+		unsigned int writable = writableContainer(nested);
+		if(writable != nested)
+			*nestedIndex = (position == 0) ? (writable | (*nestedIndex & hasTwoElementsBit)) : writable;
+		
+		path[level - 1] = writable;
+		nestedPosition[level] = position;
+	}
+	
+	//insert into the bottom container, promoting the middle value of full containers to the position after them in their parent
+	snapshotContainer* bottom = container(path[0]);
+	int position = (value >= bottom->val0) + ((bottom->nestedContainer & hasTwoElementsBit) && value >= bottom->val1);
+	unsigned int newNestedContainer = 0;
+	for(int level = 0;;++level){
+		snapshotContainer* destination = container(path[level]);
+		
+		//no promotion, just insert
+		if(!(destination->nestedContainer & hasTwoElementsBit)){
+			if(position == 0){
+				destination->val1 = destination->val0;
+				destination->nestedContainer1 = destination->nestedContainer0;
+				destination->val0 = value;
+				destination->nestedContainer0 = newNestedContainer;
+			}
+			else{
+				destination->val1 = value;
+				destination->nestedContainer1 = newNestedContainer;
+			}
+			destination->nestedContainer |= hasTwoElementsBit;
+			return;
+		}
+		
+		//line up the three values in order, keep the lowest in the destination and move the highest to a new container
+		int values[3];
+		unsigned int nestedContainers[3];	//the nested containers after each of the three values
+		values[position] = value;
+		nestedContainers[position] = newNestedContainer;
+		values[position == 0 ? 1 : 0] = destination->val0;
+		nestedContainers[position == 0 ? 1 : 0] = destination->nestedContainer0;
+		values[position == 2 ? 1 : 2] = destination->val1;
+		nestedContainers[position == 2 ? 1 : 2] = destination->nestedContainer1;
+		
+		unsigned int newContainerIndex = newContainer();
+		snapshotContainer* newContainer = container(newContainerIndex);
+		newContainer->val0 = values[2];
+		newContainer->nestedContainer = nestedContainers[1];
+		newContainer->nestedContainer0 = nestedContainers[2];
+		
+		destination->val0 = values[0];
+		destination->nestedContainer &= ~hasTwoElementsBit;
+		destination->nestedContainer0 = nestedContainers[0];
+		
+		value = values[1];
+		newNestedContainer = newContainerIndex;
+		
+		//when there is no parent, create a new super parent
+		if(level == depth){
+			superParent = this->newContainer();
+			snapshotContainer* newSuperParent = container(superParent);
+			newSuperParent->val0 = value;
+			newSuperParent->nestedContainer = path[level];
+			newSuperParent->nestedContainer0 = newNestedContainer;
+			++depth;
+			return;
+		}
+		position = nestedPosition[level + 1];
+	}
+}
+
+
+void SnapshotPyramid::publish(){
+	unsigned long sequence = publishSequence.load(std::memory_order_relaxed);
+	publishSequence.store(sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	publishedSuperParent.store(superParent, std::memory_order_relaxed);
+	publishedDepth.store(depth, std::memory_order_relaxed);
+	publishedCount.store(count, std::memory_order_relaxed);
+	publishedVersion.store(buildingVersion, std::memory_order_relaxed);
+	publishSequence.store(sequence + 2, std::memory_order_release);
+	++buildingVersion;
+	
+	//reuse the retired containers of versions older than every snapshot. Readers still taking a snapshot of an older version will see it is no
+		//longer the published version and start over
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	unsigned long oldestVersion = claimedSlot;
+	for(int i = 0;i < maxReaders;++i){
+		unsigned long version = readers[i].version.load();
+		if(version != 0)
+			oldestVersion = std::min(oldestVersion, version);
+	}
+	
+	while(retiredStart < retiredEnd && retiredVersions[retiredStart] < oldestVersion){
+		unsigned int index = retiredContainers[retiredStart++];
+		container(index)->nestedContainer0 = freeContainers;
+		freeContainers = index;
+	}
+}
+
+
+PyramidSnapshot::PyramidSnapshot(const SnapshotPyramid& pyramid){
+	this->pyramid = &pyramid;
+	SnapshotPyramid& sharedPyramid = const_cast<SnapshotPyramid&>(pyramid);	//only the reader slots are written
+	
+	//claim a free reader slot
+	for(slot = 0;;slot = (slot + 1) % SnapshotPyramid::maxReaders){
+		unsigned long freeSlot = 0;
+		if(sharedPyramid.readers[slot].version.compare_exchange_strong(freeSlot, claimedSlot))
+			break;
+		if(slot == SnapshotPyramid::maxReaders - 1)
+			std::this_thread::yield();
+	}
+	
+	while(true){
+		//read the published version, trying again if the writer was publishing
+		unsigned long sequence = pyramid.publishSequence.load(std::memory_order_acquire);
+		if(sequence & 1)
+			continue;
+		unsigned long version = pyramid.publishedVersion.load(std::memory_order_relaxed);
+		superParent = pyramid.publishedSuperParent.load(std::memory_order_relaxed);
+		depth = pyramid.publishedDepth.load(std::memory_order_relaxed);
+		count = pyramid.publishedCount.load(std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if(pyramid.publishSequence.load(std::memory_order_relaxed) != sequence)
+			continue;
+		
+		//hold the version, and make sure the writer hasn't moved past it in the meantime
+		sharedPyramid.readers[slot].version.store(version);
+		if(pyramid.publishedVersion.load() == version)
+			break;
+		sharedPyramid.readers[slot].version.store(claimedSlot);
+	}
+}
+
+PyramidSnapshot::~PyramidSnapshot(){
+	const_cast<SnapshotPyramid*>(pyramid)->readers[slot].version.store(0, std::memory_order_release);
+}
+
+
+//Go down the first nested containers from the current level to the bottom
+PyramidSnapshot::iterator PyramidSnapshot::begin() const{
+	iterator location;
+	if(superParent == 0)
+		return location;
+	
+	location.pyramid = pyramid;
+	location.depth = depth;
+	unsigned int current = superParent;
+	for(int level = depth;level >= 0;--level){
+		location.pathContainer[level] = current;
+		location.pathPosition[level] = 0;
+		current = pyramid->container(current)->nestedContainer & ~hasTwoElementsBit;
+	}
+	location.level = 0;
+	return location;
+}
+
+PyramidSnapshot::iterator PyramidSnapshot::lowerBound(int key) const{
+	iterator location;
+	if(superParent == 0)
+		return location;
+	
+	//go down to the first value of at least key, passing the values lower than key
+	location.pyramid = pyramid;
+	location.depth = depth;
+	unsigned int current = superParent;
+	for(int level = depth;level >= 0;--level){
+		const snapshotContainer* container = pyramid->container(current);
+		bool hasTwoElements = container->nestedContainer & hasTwoElementsBit;
+		int position = (container->val0 < key) + (hasTwoElements && container->val1 < key);
+		location.pathContainer[level] = current;
+		location.pathPosition[level] = position;
+		current = (position == 0) ? (container->nestedContainer & ~hasTwoElementsBit) : 
+					(position == 1) ? container->nestedContainer0 : container->nestedContainer1;
+	}
+	
+	//when every value of the bottom container is lower, the first value of at least key is the next one up the path
+	const snapshotContainer* bottom = pyramid->container(location.pathContainer[0]);
+	if(location.pathPosition[0] < ((bottom->nestedContainer & hasTwoElementsBit) ? 2 : 1))
+		location.level = 0;
+	else
+		location.nextUp();
+	return location;
+}
+
+
+int PyramidSnapshot::iterator::operator*() const{
+	const snapshotContainer* container = pyramid->container(pathContainer[level]);
+	return (pathPosition[level] == 0) ? container->val0 : container->val1;
+}
+
+//Move to the element after the nested container the path took on the lowest level above the bottom that has one, or to the end
+void PyramidSnapshot::iterator::nextUp(){
+	for(int up = 1;up <= depth;++up){
+		const snapshotContainer* container = pyramid->container(pathContainer[up]);
+		if(pathPosition[up] < ((container->nestedContainer & hasTwoElementsBit) ? 2 : 1)){
+			level = up;
+			return;
+		}
+	}
+	level = -1;
+}
+
+PyramidSnapshot::iterator& PyramidSnapshot::iterator::operator++(){
+	const snapshotContainer* container = pyramid->container(pathContainer[level]);
+	
+	//go down to the bottom through the nested container after the current element, then along the first nested containers
+	if(level > 0){
+		++pathPosition[level];
+		unsigned int current = (pathPosition[level] == 1) ? container->nestedContainer0 : container->nestedContainer1;
+		for(int down = level - 1;down >= 0;--down){
+			pathContainer[down] = current;
+			pathPosition[down] = 0;
+			current = pyramid->container(current)->nestedContainer & ~hasTwoElementsBit;
+		}
+		level = 0;
+	}
+	else if(pathPosition[0] == 0 && (container->nestedContainer & hasTwoElementsBit)){
+		pathPosition[0] = 1;
+	}
+	else{
+		nextUp();
+	}
+	return *this;
+}
+
+bool PyramidSnapshot::iterator::operator==(const iterator& other) const{
+	if(level == -1 || other.level == -1)
+		return level == other.level;
+	return pathContainer[level] == other.pathContainer[level] && pathPosition[level] == other.pathPosition[level];
+}
@@ -0,0 +1,227 @@
+
+#ifndef pyramid_sort
+#define pyramid_sort
+
+#include <atomic>
+
+//Keep a count of the values in each container and its nested containers, for PyramidQueue's rank and select
+//#define VALUE_COUNTS
+
+struct elementContainer; struct element; struct snapshotContainer;
+template<int maxElements> struct wideContainer;
+
+
+//Perform pyramid sort with internal allocation/deallocation of memory
+void pyramidSort(int* array, int arrayLength);
+//Perform pyramid sort with external allocation/deallocation of memory
+void pyramidSort(int *array, int arrayLength, elementContainer* containerMemory);
+//Perform pyramid sort with containers of up to 16 elements, or pyramidSort for short arrays
+void widePyramidSort(int* array, int arrayLength);
+//Perform pyramid sort with containers of up to maxElements elements (2, 4, 8, 16 or 32), with internal allocation/deallocation of memory
+template<int maxElements> void widePyramidSort(int* array, int arrayLength);
+//Perform pyramid sort with containers of up to maxElements elements, using containerMemory of at least wideContainersNeeded<maxElements>(arrayLength)
+template<int maxElements> void widePyramidSort(int* array, int arrayLength, wideContainer<maxElements>* containerMemory);
+//Most containers widePyramidSort<maxElements> uses for arrayLength elements
+template<int maxElements> int wideContainersNeeded(int arrayLength);
+//Bytes of memory taken by wideContainersNeeded<maxElements>(arrayLength) containers
+template<int maxElements> long wideContainerMemoryBytes(int arrayLength);
+//Perform pyramid sort with 20 byte containers
+void compactPyramidSort(int* array, int arrayLength);
+
+//Allocates memory for allContainers based on the array length
+void allocateMemory(int arrayLength, elementContainer*& allContainers);
+//Deallocates memory for allContainers
+void deallocateMemory(elementContainer*& allContainers);
+//Bytes allocateMemory takes for arrayLength elements
+long containerMemoryBytes(int arrayLength);
+
+
+//Containers for PyramidQueues, allocated a chunk at a time and reused once released. Queues that are joined or split share a pool, so that containers
+	//can move from one queue to the other
+class PyramidPool {
+	public:
+	PyramidPool();
+	~PyramidPool();
+	PyramidPool(const PyramidPool&) = delete;
+	PyramidPool& operator=(const PyramidPool&) = delete;
+
+	elementContainer* acquire();
+	void release(elementContainer* container);
+	void adopt(PyramidPool& other);	//Take over all of other's containers, in use or not. other is left empty
+	long reservedBytes() const;	//Memory taken by the pool's containers, in use or not. It only grows until the pool is destroyed
+
+	private:
+	elementContainer* freeContainers;	//Containers not in use, linked through parentContainer
+	elementContainer** chunks;
+	int numChunks;
+	int chunksLength;
+};
+
+
+//Priority queue built from pyramid sort's containers. Values are pushed into the bottom nest level and promoted like in pyramidSort, and removed from
+	//either end by demotion (the inverse of a promotion): a container left without elements takes an element from its neighbour through the parent, 
+	//or is merged with it
+class PyramidQueue {
+	public:
+	PyramidQueue(PyramidPool* pool = nullptr);	//Without a pool, the queue has one of its own
+	PyramidQueue(const int* values, int length, PyramidPool* pool = nullptr);	//Holds values, which are sorted from lowest to highest, without pushing them one at a time
+	~PyramidQueue();
+	PyramidQueue(const PyramidQueue&) = delete;
+	PyramidQueue& operator=(const PyramidQueue&) = delete;
+
+	void push(int value);
+	int min() const;	//The queue must not be empty
+	int max() const;	//The queue must not be empty
+	int popMin();	//Removes and returns the lowest value. The queue must not be empty
+	int popMax();	//Removes and returns the highest value. The queue must not be empty
+	int topK(int k, int* values) const;	//Writes the k highest values from highest to lowest (all values if there are less), returns how many were written
+	int size() const;
+	bool empty() const { return superParent == nullptr; }
+	#ifdef VALUE_COUNTS
+	int rank(int key) const;	//Number of values lower than key
+	int select(int rank) const;	//The value with rank values lower than it, from 0 up to size() - 1
+	#endif
+
+	//other must share this queue's pool or have a pool of its own, which this queue's pool then takes over. other is left empty
+	void join(PyramidQueue& higher);	//Move in the values of higher, which are all at least as high as this queue's values
+	void merge(PyramidQueue& other);	//Move in the values of other, joining when one queue's values are all lower than the other's
+	//higher must be empty and share this queue's pool
+	void splitAtKey(int key, PyramidQueue& higher);	//Move the values of at least key to higher
+	void splitAtRank(int rank, PyramidQueue& higher);	//Keep the lowest rank values, move the rest to higher. Without VALUE_COUNTS it counts them
+
+	private:
+	elementContainer* superParent;	//nullptr when the queue is empty
+	int depth;	//Nest levels below the superParent
+	mutable int count;	//-1 after a split by key without VALUE_COUNTS, until size() counts the values
+
+	PyramidPool ownPool;
+	PyramidPool* pool;	//Either ownPool or a pool shared with other queues
+
+	void promoteAt(elementContainer* container, int position, int value, elementContainer* nestedContainer, elementContainer*& top, int& topDepth);
+	void joinWithKey(elementContainer*& top, int& topDepth, int key, elementContainer* higherTop, int higherDepth);
+	void split(const int* nestedPosition, int bottomLength, PyramidQueue& higher);
+	void takePool(PyramidQueue& other);
+	void releaseContainers(elementContainer* source, int level);
+	void demoteFirst(elementContainer* container);
+	void demoteLast(elementContainer* container);
+	void placeGreatest(const elementContainer* source, int level, int k, int* values, int& index) const;
+};
+
+
+//Keeps the k highest values of a stream in a PyramidQueue
+class TopKTracker {
+	public:
+	TopKTracker(int k) : k(k) {}
+
+	void add(int value){
+		if(queue.size() < k)
+			queue.push(value);
+		else if(k > 0 && value > queue.min()){
+			queue.popMin();
+			queue.push(value);
+		}
+	}
+	int values(int* values) const { return queue.topK(k, values); }	//Writes the values from highest to lowest, returns how many were written
+	int size() const { return queue.size(); }
+
+	private:
+	PyramidQueue queue;
+	int k;
+};
+
+
+//Pyramid with one writer that readers can take snapshots of while it keeps inserting. Inserted values become visible to snapshots taken after the
+	//writer publishes them. Containers a published version still uses are copied before they are changed, and reused once no snapshot can reach them.
+	//Readers never make the writer wait
+class SnapshotPyramid {
+	friend class PyramidSnapshot;
+
+	public:
+	static const int maxReaders = 64;	//Snapshots that can be open at once, more wait for one to close
+	static const int maxDepth = 40;	//Deeper than any pyramid of 2^31 elements
+
+	SnapshotPyramid();
+	~SnapshotPyramid();
+	SnapshotPyramid(const SnapshotPyramid&) = delete;
+	SnapshotPyramid& operator=(const SnapshotPyramid&) = delete;
+
+	//Only called by the writer
+	void insert(int value);
+	void publish();	//Make the values inserted so far visible to new snapshots, and reuse the containers that no open snapshot can reach
+	long size() const { return count; }
+
+	private:
+	struct alignas(64) readerSlot {
+		std::atomic<unsigned long> version;	//The version the reader's snapshot is of, 0 when the slot is free
+	};
+
+	//The published version, read with a sequence lock: the sequence is odd while the writer changes the rest
+	std::atomic<unsigned long> publishSequence;
+	std::atomic<unsigned long> publishedVersion;
+	std::atomic<unsigned int> publishedSuperParent;
+	std::atomic<int> publishedDepth;
+	std::atomic<long> publishedCount;
+	readerSlot readers[maxReaders];
+
+	//The writer's version, unpublished until publish()
+	unsigned long buildingVersion;
+	unsigned int superParent;	//0 when the pyramid is empty
+	int depth;
+	long count;
+
+	snapshotContainer** chunks;	//Containers by index, a chunk at a time so that they never move
+	unsigned int nextContainer;	//The next container never used
+	unsigned int freeContainers;	//Containers to reuse, linked through nestedContainer0
+	unsigned int* retiredContainers;	//Containers replaced by copies, with the last version that uses them, oldest first
+	unsigned long* retiredVersions;
+	int retiredStart;
+	int retiredEnd;
+	int retiredLength;
+
+	snapshotContainer* container(unsigned int index) const;
+	unsigned int newContainer();
+	unsigned int writableContainer(unsigned int index);
+	void retire(unsigned int index);
+};
+
+//A reader's view of a SnapshotPyramid as of the last version published when it was taken. Scanning it is unaffected by the writer's inserts
+class PyramidSnapshot {
+	public:
+	PyramidSnapshot(const SnapshotPyramid& pyramid);
+	~PyramidSnapshot();
+	PyramidSnapshot(const PyramidSnapshot&) = delete;
+	PyramidSnapshot& operator=(const PyramidSnapshot&) = delete;
+
+	//Forward iterator over the values in sorted order. Holds the path of containers from the superParent down to the current element
+	class iterator {
+		friend class PyramidSnapshot;
+		const SnapshotPyramid* pyramid;
+		unsigned int pathContainer[SnapshotPyramid::maxDepth + 1];
+		int pathPosition[SnapshotPyramid::maxDepth + 1];	//The nested container taken above the current element, the current element on its level
+		int level;	//Nest level of the current element, -1 for the end iterator
+		int depth;
+
+		void nextUp();
+
+		public:
+		iterator(){ level = -1; }
+		int operator*() const;
+		iterator& operator++();
+		bool operator==(const iterator& other) const;
+		bool operator!=(const iterator& other) const { return !(*this == other); }
+	};
+
+	iterator begin() const;
+	iterator lowerBound(int key) const;	//First value not less than key
+	iterator end() const { return iterator(); }
+	long size() const { return count; }
+
+	private:
+	const SnapshotPyramid* pyramid;
+	int slot;
+	unsigned int superParent;
+	int depth;
+	long count;
+};
+
+#endif
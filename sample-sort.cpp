@@ -0,0 +1,145 @@
+//Sample sort
+
+#include <climits>	//INT_MIN
+#include <algorithm>	//sort, copy, min, max
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "sample-sort.h"
+
+
+/****************************************************************
+SAMPLE SORT******************************************************
+*****************************************************************
+-Fixed tree sort splits the values by the first ones to fill the top of its tree, which makes it a distribution sort with splitters picked by
+	the order of the input. Sample sort picks the splitters from a sample of the values instead, sorted and taken evenly, so that the buckets
+	between them are about the same size whatever order the values come in. The sample has oversampling values for each bucket.
+-The splitters are laid out like fixed tree sort's tree, sorted, with the root in the middle and each level's dividers half as far apart as the
+	last. A value's bucket is found by the same descent, adding the divider to the position when the value is at least the splitter there, which
+	compiles to a conditional move rather than a branch, so classifying a value is one comparison for each level and never a misprediction.
+-Each splitter also has a bucket of its own for the values equal to it, placed before the bucket of the values between it and the next one.
+	Those buckets don't need sorting, and a value held by many elements of the array can't make one bucket take most of them.
+-Threads work on their own parts of the array without locks. Each counts the values of its part that go in each bucket, then a prefix sum of
+	the counts gives each thread the place in each bucket for its values, and each moves its part's values to their buckets in a buffer. The
+	buckets are then sorted with any of the sorts, threads taking the next bucket not yet taken until none are left, and copied back.
+*****************************************************************/
+
+
+const int bucketsPerThread = 16;	//Buckets between splitters for each thread, so that threads taking the next bucket end about together
+const int oversampling = 32;	//Sample values for each bucket
+const int minSampleSortLength = 1 << 16;	//Shorter arrays are sorted by sort alone
+
+
+//The bucket of a value, found at the position of the highest splitter not above it: 2 * position if the value equals that splitter, and 
+	//2 * position + 1 if it is between it and the next. splitters[0] is INT_MIN, below the splitters taken from the sample
+inline int bucketOf(int value, const int* splitters, int numSplitBuckets){
+	int position = 0;
+	for(int divider = numSplitBuckets / 2;divider > 0;divider /= 2){
+		position += (value >= splitters[position + divider]) ? divider : 0;
+	}
+	return 2 * position + (value != splitters[position]);
+}
+
+
+void sampleSort(int* array, int arrayLength, int numThreads, sortFunction sort){
+	if(arrayLength < minSampleSortLength){
+		if(arrayLength > 1)
+			sort(array, arrayLength);
+		return;
+	}
+	numThreads = std::max(1, numThreads);
+
+	//a power of 2 buckets between splitters, each after a bucket of values equal to its lowest splitter
+	int numSplitBuckets = 1;
+	while(numSplitBuckets < bucketsPerThread * numThreads){
+		numSplitBuckets *= 2;
+	}
+	int numBuckets = 2 * numSplitBuckets;
+
+	//splitters taken evenly from a sorted sample at random places of the array
+	int sampleLength = std::min(arrayLength, oversampling * numSplitBuckets);
+	int* sample = new int[sampleLength];
+	unsigned long random = 88172645463325252ul;	//xorshift
+	for(int i = 0;i < sampleLength;++i){
+		random ^= random << 13;
+		random ^= random >> 7;
+		random ^= random << 17;
+		sample[i] = array[random % arrayLength];
+	}
+	std::sort(sample, sample + sampleLength);
+	int* splitters = new int[numSplitBuckets];
+	splitters[0] = INT_MIN;
+	for(int i = 1;i < numSplitBuckets;++i){
+		splitters[i] = sample[(long)i * sampleLength / numSplitBuckets];
+	}
+	delete[] sample;
+
+	//each thread counts the values of its part for each bucket
+	long* counts = new long[(long)numThreads * numBuckets]();
+	std::vector<std::thread> threads;
+	for(int t = 0;t < numThreads;++t){
+		threads.emplace_back([=](){
+			long* threadCounts = counts + (long)t * numBuckets;
+			long end = (long)(t + 1) * arrayLength / numThreads;
+			for(long i = (long)t * arrayLength / numThreads;i < end;++i){
+				++threadCounts[bucketOf(array[i], splitters, numSplitBuckets)];
+			}
+		});
+	}
+	for(std::thread& thread : threads){
+		thread.join();
+	}
+	threads.clear();
+
+	//the buckets one after another, each thread's values in a bucket after those of the threads before it. counts becomes each thread's
+		//place in each bucket
+	long* bucketStart = new long[numBuckets + 1];
+	long place = 0;
+	for(int bucket = 0;bucket < numBuckets;++bucket){
+		bucketStart[bucket] = place;
+		for(int t = 0;t < numThreads;++t){
+			long count = counts[(long)t * numBuckets + bucket];
+			counts[(long)t * numBuckets + bucket] = place;
+			place += count;
+		}
+	}
+	bucketStart[numBuckets] = place;
+
+	//each thread moves the values of its part to their buckets
+	int* buffer = new int[arrayLength];
+	for(int t = 0;t < numThreads;++t){
+		threads.emplace_back([=](){
+			long* threadPlaces = counts + (long)t * numBuckets;
+			long end = (long)(t + 1) * arrayLength / numThreads;
+			for(long i = (long)t * arrayLength / numThreads;i < end;++i){
+				buffer[threadPlaces[bucketOf(array[i], splitters, numSplitBuckets)]++] = array[i];
+			}
+		});
+	}
+	for(std::thread& thread : threads){
+		thread.join();
+	}
+	threads.clear();
+
+	//each thread sorts the next bucket not yet taken and copies it back. The buckets of values equal to a splitter are only copied
+	std::atomic<int> nextBucket(0);
+	for(int t = 0;t < numThreads;++t){
+		threads.emplace_back([=, &nextBucket](){
+			for(int bucket = nextBucket++;bucket < numBuckets;bucket = nextBucket++){
+				long start = bucketStart[bucket];
+				long length = bucketStart[bucket + 1] - start;
+				if(bucket % 2 == 1 && length > 1)
+					sort(buffer + start, (int)length);
+				std::copy(buffer + start, buffer + start + length, array + start);
+			}
+		});
+	}
+	for(std::thread& thread : threads){
+		thread.join();
+	}
+
+	delete[] splitters;
+	delete[] counts;
+	delete[] bucketStart;
+	delete[] buffer;
+}
@@ -0,0 +1,15 @@
+
+#ifndef sample_sort
+#define sample_sort
+
+#include "pyramid-sort.h"
+
+
+//A sort of a whole array, such as pyramidSort, trailSort or treeSort
+typedef void (*sortFunction)(int* array, int arrayLength);
+
+//Sort an array with numThreads threads: the values are split into buckets by splitters taken from a sample of them, and the buckets are sorted
+	//with sort. Takes a buffer as long as the array
+void sampleSort(int* array, int arrayLength, int numThreads, sortFunction sort = pyramidSort);
+
+#endif
@@ -1,5 +1,7 @@
 //Trail sort
 
+#include <algorithm>	//copy
+
 
 /****************************************************************
 TRAIL SORT*****************************************************
@@ -62,30 +64,42 @@ This current implementation is much too complicated. Although the idea for sorti
 The performance gains of such a complicated method are nothing special, either. Although the average growth of this algorithm is 
 	linearithmic, it is with a rather high coefficient compared to other linearithmic scaling algorithms. Not only that, in heavily
 	zig-zagging trees the performance can degrade to O(n^2), similar to how quick sort degrades on sorted / reverse sorted arrays.
+
+Depth limit*************
+The shifts don't bound the depth: inserting values from both ends towards the middle makes a single zig-zagging trail as deep as the number of 
+	elements. So insertVal keeps track of how deep it goes, and when a new element would be deeper than 3 log2 of the number of elements, it 
+	rebuilds part of the tree the way a scapegoat tree does. Going up from the new element, the first element with more than 3/4 of its elements on 
+	one side is the scapegoat (there is always one past log base 4/3 of the number of elements, which 3 log2 is at least), and its elements are 
+	laid out again as a balanced tree. Rebuilding a subtree costs as much as its elements, but it takes as many inserts to unbalance it again, so 
+	the worst case stays O(n log n).
+The superParent is above the peak only so that the peak has a parent. The shifts stop at it instead of it having a height too large to shift.
 *****************************************************************/
 
-struct element;
+#include "trail-sort.h"
 
 
-void updateTree(element* comparisonElement, bool isTrailLesser);
+void updateTree(trailElement* comparisonElement, bool isTrailLesser);
+int maxTrailDepth(int numElements);
+void rebuildScapegoat(trailElement* newElement);
 
 
 //contains the value of the element and necessary tracked variables
-struct element{
+struct trailElement{
 	int val;
-	element* parent;
-	element* lesserChild;
-	element* greaterChild;
+	trailElement* parent;
+	trailElement* lesserChild;
+	trailElement* greaterChild;
 	int trailLength;
 	int height;
 	bool isParentLesser;
 };
 
 
-//Insert an element into the binary tree
-void insertVal(int value, element* peak, element*& elementAssigner){
+//Insert an element into the binary tree, which then holds numElements elements
+void insertVal(int value, trailElement* peak, trailElement*& elementAssigner, int numElements){
 	
-	element*& comparisonElement = peak;
+	trailElement*& comparisonElement = peak;
+	int depth = 1;	//of the comparisonElement, counting the peak as 1
 	
 	//Loop until the lowest nest level is reached
 	while(true)
@@ -94,6 +108,7 @@ void insertVal(int value, element* peak, element*& elementAssigner){
 		if(value >= comparisonElement->val){
 			if(comparisonElement->greaterChild != nullptr){
 				comparisonElement = comparisonElement->greaterChild;
+				++depth;
 				continue;
 			}
 			else{
@@ -106,13 +121,18 @@ void insertVal(int value, element* peak, element*& elementAssigner){
 				comparisonElement->greaterChild->trailLength = 0;
 				comparisonElement->greaterChild->height = 0;
 				comparisonElement->greaterChild->isParentLesser = true;
-				updateTree(comparisonElement, true);
+				
+				if(depth + 1 > maxTrailDepth(numElements))
+					rebuildScapegoat(comparisonElement->greaterChild);
+				else
+					updateTree(comparisonElement, true);
 				break;
 			}
 		}
 		else{
 			if(comparisonElement->lesserChild != nullptr){
 				comparisonElement = comparisonElement->lesserChild;
+				++depth;
 				continue;
 			}
 			else{
@@ -126,7 +146,10 @@ void insertVal(int value, element* peak, element*& elementAssigner){
 				comparisonElement->lesserChild->height = 0;
 				comparisonElement->lesserChild->isParentLesser = false;
 				
-				updateTree(comparisonElement, false);
+				if(depth + 1 > maxTrailDepth(numElements))
+					rebuildScapegoat(comparisonElement->lesserChild);
+				else
+					updateTree(comparisonElement, false);
 				break;
 			}
 		}
@@ -136,10 +159,10 @@ void insertVal(int value, element* peak, element*& elementAssigner){
 
 
 //Checks parent elements for any triggered shifts. 
-void updateTree(element* comparisonElement, bool isTrailLesser){
+void updateTree(trailElement* comparisonElement, bool isTrailLesser){
 	
 	
-	element tmp;	//for swapping values in case a shift occurs
+	trailElement tmp;	//for swapping values in case a shift occurs
 	while(comparisonElement->isParentLesser == isTrailLesser){
 		//if the disparity between the height and the trailLength won't become 2
 		if(comparisonElement->height - comparisonElement->trailLength != 1){
@@ -205,6 +228,10 @@ void updateTree(element* comparisonElement, bool isTrailLesser){
 	}
 	
 	
+	//the superParent doesn't shift
+	if(comparisonElement->parent == nullptr)
+		return;
+	
 	//none of the trail had to shift, so check for a shift at the top of the trail
 	if(comparisonElement->trailLength - comparisonElement->height < 1){
 		//no shift is needed, update trail length and return
@@ -272,8 +299,108 @@ void updateTree(element* comparisonElement, bool isTrailLesser){
 }
 
 
+//The depth past which an insert rebuilds part of the tree: 3 log2 of the number of elements, rounded up
+int maxTrailDepth(int numElements){
+	int bits = 0;
+	while((numElements >> bits) > 0){
+		++bits;
+	}
+	return 3 * bits;
+}
+
+
+//The trail lengths on the lesser and greater side of an element, whichever of trailLength and height they are
+int lowerTrailLength(const trailElement* source){
+	return source->isParentLesser ? source->trailLength : source->height;
+}
+int higherTrailLength(const trailElement* source){
+	return source->isParentLesser ? source->height : source->trailLength;
+}
+void setTrailLengths(trailElement* source, int lowerLength, int higherLength){
+	source->trailLength = source->isParentLesser ? lowerLength : higherLength;
+	source->height = source->isParentLesser ? higherLength : lowerLength;
+}
+
+
+int countElements(const trailElement* source){
+	if(source == nullptr)
+		return 0;
+	return countElements(source->lesserChild) + 1 + countElements(source->greaterChild);
+}
+
+void listElements(trailElement* source, trailElement** elements, int& index){
+	if(source->lesserChild != nullptr){
+		listElements(source->lesserChild, elements, index);
+	}
+	elements[index++] = source;
+	if(source->greaterChild != nullptr){
+		listElements(source->greaterChild, elements, index);
+	}
+}
+
+//Link the elements, which are in order, into a balanced tree with the middle element as its peak. The trail lengths are those of the tree as it is
+trailElement* buildBalancedTree(trailElement** elements, int length, trailElement* parent, bool isParentLesser){
+	if(length == 0)
+		return nullptr;
+	
+	int middle = length / 2;
+	trailElement* peak = elements[middle];
+	peak->parent = parent;
+	peak->isParentLesser = isParentLesser;
+	peak->lesserChild = buildBalancedTree(elements, middle, peak, false);
+	peak->greaterChild = buildBalancedTree(elements + middle + 1, length - middle - 1, peak, true);
+	setTrailLengths(peak, (peak->lesserChild != nullptr) ? lowerTrailLength(peak->lesserChild) + 1 : 0, 
+					(peak->greaterChild != nullptr) ? higherTrailLength(peak->greaterChild) + 1 : 0);
+	return peak;
+}
+
+
+//Find the first element above newElement with more than 3/4 of its elements on one side, or the peak if there isn't one, and rebuild it as a 
+	//balanced tree
+void rebuildScapegoat(trailElement* newElement){
+	trailElement* scapegoat = newElement;
+	int numElements = 1;
+	while(scapegoat->parent->parent != nullptr){
+		trailElement* parent = scapegoat->parent;
+		int parentElements = numElements + 1 + countElements((parent->lesserChild == scapegoat) ? parent->greaterChild : parent->lesserChild);
+		scapegoat = parent;
+		if(4 * numElements > 3 * parentElements){
+			numElements = parentElements;
+			break;
+		}
+		numElements = parentElements;
+	}
+	
+	trailElement* parent = scapegoat->parent;
+	bool isParentLesser = scapegoat->isParentLesser;
+	trailElement** elements = new trailElement*[numElements];
+	int index = 0;
+	listElements(scapegoat, elements, index);
+	trailElement* peak = buildBalancedTree(elements, numElements, parent, isParentLesser);
+	delete[] elements;
+	if(isParentLesser)
+		parent->greaterChild = peak;
+	else
+		parent->lesserChild = peak;
+	
+	//the trail the rebuilt elements are on continues up through the elements on the same side of their parent
+	trailElement* source = peak;
+	while(source->parent->parent != nullptr){
+		trailElement* trailAbove = source->parent;
+		if(isParentLesser)
+			setTrailLengths(trailAbove, lowerTrailLength(trailAbove), higherTrailLength(source) + 1);
+		else
+			setTrailLengths(trailAbove, lowerTrailLength(source) + 1, higherTrailLength(trailAbove));
+		
+		if(trailAbove->isParentLesser != isParentLesser)
+			break;
+		source = trailAbove;
+	}
+}
+
+
 //Transfer the values from the binary tree to the array
-void placeElementsInArray(element* source, int* array, int& index){
+void placeElementsInArray(trailElement* source, int* array, int& index){
 	if(source->lesserChild != nullptr){
 		placeElementsInArray(source->lesserChild, array, index);
 	}
@@ -286,21 +413,23 @@ void placeElementsInArray(element* source, int* array, int& index){
 
 
 //Allocates memory for elements based on the array length !!!return pointer to the memory instead of using an out parameter
-void allocateMemory(int arrayLength, element*& elementMemory){
-	elementMemory = new element[arrayLength + 1];
+void allocateMemory(int arrayLength, trailElement*& elementMemory){
+	elementMemory = new trailElement[arrayLength + 1];
 }
 //Deallocates memory for elements
-void deallocateMemory(element*& elementMemory){
+void deallocateMemory(trailElement*& elementMemory){
 	delete[] elementMemory;
 	elementMemory = nullptr;
 }
 
 
-element* initSuperParent(element*& elementAssigner, int val){
-	element* superParent = elementAssigner++;
-	superParent->trailLength = 1;
+trailElement* initSuperParent(trailElement*& elementAssigner, int val){
+	trailElement* superParent = elementAssigner++;
+	superParent->parent = nullptr;	//so that shifts stop at the top
+	superParent->lesserChild = nullptr;
+	superParent->trailLength = 0;
+	superParent->height = 0;
 	superParent->isParentLesser = false;	//so there is a change in direction at the top
-	superParent->height = 999999;	//!!! int max to prevent shifts
 	
 	superParent->greaterChild = elementAssigner++;;
 	superParent->greaterChild->val = val;
@@ -315,15 +444,15 @@ element* initSuperParent(element*& elementAssigner, int val){
 }
 
 
-void trailSort(int *array, int arrayLength, element* elementAssigner){
+void trailSort(int *array, int arrayLength, trailElement* elementAssigner){
 	if(arrayLength <= 1)
 		return;
 	
-	element* superParent = initSuperParent(elementAssigner, array[0]);
+	trailElement* superParent = initSuperParent(elementAssigner, array[0]);
 	
 	//Place the rest of the elements
 	for(int i = 1;i < arrayLength;++i){
-		insertVal(array[i],superParent->greaterChild,elementAssigner);
+		insertVal(array[i],superParent->greaterChild,elementAssigner,i + 1);
 	}
 	
 	int index = 0;
@@ -332,9 +461,596 @@ void trailSort(int *array, int arrayLength, element* elementAssigner){
 
 
 void trailSort(int* array, int arrayLength){
-	element* elementMemory;
+	trailElement* elementMemory;
 	allocateMemory(arrayLength,elementMemory);
 	trailSort(array, arrayLength, elementMemory);
 	deallocateMemory(elementMemory);
 }
 
+
+
+
+
+/****************************************************************
+COMPACT TRAIL SORT***********************************************
+*****************************************************************
+-Compact trail sort makes the same shifts as trailSort with a 16 byte element instead of 40: the value, two 32 bit indices of the children into the
+	element memory, and two 16 bit trail lengths.
+-The trailLength and height of an element are the lengths on its two sides, and which is which depends on the direction to its parent. Here they are
+	kept as lowerTrailLength and higherTrailLength instead, so an element changing direction in a shift keeps its lengths as they are rather than 
+	swapping them, and isParentLesser isn't needed.
+-There is no parent. Instead the elements passed on the way down are kept in a path, and updates go back up the path. The direction to the parent is
+	whether the element is the parent's greaterChild.
+-Index 0 is the superParent, so it also means there is no child: the superParent is never a child. The updates stop at the superParent rather than 
+	blocking shifts with a large height.
+-The depth is limited like trailSort's, with the scapegoat found going up the path. That keeps the trail lengths well within 16 bits.
+*****************************************************************/
+
+
+struct compactTrailElement{
+	int val;
+	unsigned int lesserChild;
+	unsigned int greaterChild;
+	unsigned short lowerTrailLength;	//height when the parent is greater, trailLength when the parent is lesser
+	unsigned short higherTrailLength;	//trailLength when the parent is greater, height when the parent is lesser
+};
+
+const int initialTrailPathLength = 64;	//Elements the path starts out holding. It doubles when the tree gets deeper
+
+
+//Checks the elements up the path for any triggered shifts, starting with path[level] whose trail grew on the greater side when isTrailLesser
+void compactUpdateTree(compactTrailElement* elements, const unsigned int* path, int level, bool isTrailLesser){
+	
+	while(level > 0){
+		compactTrailElement* comparisonElement = elements + path[level];
+		compactTrailElement* parent = elements + path[level - 1];
+		bool isParentLesser = parent->greaterChild == path[level];
+		unsigned short& grownLength = isTrailLesser ? comparisonElement->higherTrailLength : comparisonElement->lowerTrailLength;
+		int otherLength = isTrailLesser ? comparisonElement->lowerTrailLength : comparisonElement->higherTrailLength;
+		
+		if(isParentLesser == isTrailLesser){
+			//if the disparity between the height and the trailLength won't become 2
+			if(grownLength - otherLength != 1){
+				++grownLength;
+				--level;
+				continue;
+			}
+			//else shift trail and return: the grown side's child becomes the parent, and the trail branching off it towards the element changes places
+			else if(isTrailLesser){
+				unsigned int newParent = comparisonElement->greaterChild;
+				parent->greaterChild = newParent;
+				comparisonElement->greaterChild = elements[newParent].lesserChild;
+				elements[newParent].lesserChild = path[level];
+				elements[newParent].lowerTrailLength = comparisonElement->lowerTrailLength + 1;
+				comparisonElement->higherTrailLength = (comparisonElement->greaterChild != 0) ? elements[comparisonElement->greaterChild].higherTrailLength + 1 : 0;
+			}
+			else{
+				unsigned int newParent = comparisonElement->lesserChild;
+				parent->lesserChild = newParent;
+				comparisonElement->lesserChild = elements[newParent].greaterChild;
+				elements[newParent].greaterChild = path[level];
+				elements[newParent].higherTrailLength = comparisonElement->higherTrailLength + 1;
+				comparisonElement->lowerTrailLength = (comparisonElement->lesserChild != 0) ? elements[comparisonElement->lesserChild].lowerTrailLength + 1 : 0;
+			}
+			return;
+		}
+		
+		//none of the trail had to shift, so check for a shift at the top of the trail
+		if(grownLength - otherLength < 1){
+			//no shift is needed, update trail length and return
+			++grownLength;
+			return;
+		}
+		//else shift parent, then check further up the tree for shifts on the other side of the parent
+		else if(isTrailLesser){
+			unsigned int newParent = comparisonElement->greaterChild;
+			parent->lesserChild = newParent;
+			comparisonElement->greaterChild = elements[newParent].lesserChild;
+			elements[newParent].lesserChild = path[level];
+			elements[newParent].higherTrailLength = comparisonElement->higherTrailLength;
+			elements[newParent].lowerTrailLength = comparisonElement->lowerTrailLength + 1;
+			comparisonElement->higherTrailLength = (comparisonElement->greaterChild != 0) ? elements[comparisonElement->greaterChild].higherTrailLength + 1 : 0;
+		}
+		else{
+			unsigned int newParent = comparisonElement->lesserChild;
+			parent->greaterChild = newParent;
+			comparisonElement->lesserChild = elements[newParent].greaterChild;
+			elements[newParent].greaterChild = path[level];
+			elements[newParent].lowerTrailLength = comparisonElement->lowerTrailLength;
+			elements[newParent].higherTrailLength = comparisonElement->higherTrailLength + 1;
+			comparisonElement->lowerTrailLength = (comparisonElement->lesserChild != 0) ? elements[comparisonElement->lesserChild].lowerTrailLength + 1 : 0;
+		}
+		isTrailLesser = !isTrailLesser;
+		--level;
+	}
+}
+
+
+unsigned int countElements(const compactTrailElement* elements, unsigned int source){
+	if(source == 0)
+		return 0;
+	return countElements(elements, elements[source].lesserChild) + 1 + countElements(elements, elements[source].greaterChild);
+}
+
+void listElements(const compactTrailElement* elements, unsigned int source, unsigned int* list, int& index){
+	if(elements[source].lesserChild != 0){
+		listElements(elements, elements[source].lesserChild, list, index);
+	}
+	list[index++] = source;
+	if(elements[source].greaterChild != 0){
+		listElements(elements, elements[source].greaterChild, list, index);
+	}
+}
+
+//Link the listed elements, which are in order, into a balanced tree and return its peak
+unsigned int buildBalancedTree(compactTrailElement* elements, const unsigned int* list, int length){
+	if(length == 0)
+		return 0;
+	
+	int middle = length / 2;
+	compactTrailElement* peak = elements + list[middle];
+	peak->lesserChild = buildBalancedTree(elements, list, middle);
+	peak->greaterChild = buildBalancedTree(elements, list + middle + 1, length - middle - 1);
+	peak->lowerTrailLength = (peak->lesserChild != 0) ? elements[peak->lesserChild].lowerTrailLength + 1 : 0;
+	peak->higherTrailLength = (peak->greaterChild != 0) ? elements[peak->greaterChild].higherTrailLength + 1 : 0;
+	return list[middle];
+}
+
+
+//Rebuild the tree from the scapegoat of newElement, whose parent is path[level], like rebuildScapegoat
+void compactRebuildScapegoat(compactTrailElement* elements, const unsigned int* path, int level, unsigned int newElement){
+	unsigned int scapegoat = newElement;
+	int scapegoatLevel = level + 1;
+	unsigned int numElements = 1;
+	while(scapegoatLevel > 1){
+		const compactTrailElement* parent = elements + path[scapegoatLevel - 1];
+		unsigned int parentElements = numElements + 1 + countElements(elements, (parent->lesserChild == scapegoat) ? parent->greaterChild : parent->lesserChild);
+		scapegoat = path[--scapegoatLevel];
+		if(4 * numElements > 3 * parentElements){
+			numElements = parentElements;
+			break;
+		}
+		numElements = parentElements;
+	}
+	
+	compactTrailElement* parent = elements + path[scapegoatLevel - 1];
+	bool isParentLesser = parent->greaterChild == scapegoat;
+	unsigned int* list = new unsigned int[numElements];
+	int index = 0;
+	listElements(elements, scapegoat, list, index);
+	unsigned int peak = buildBalancedTree(elements, list, numElements);
+	delete[] list;
+	if(isParentLesser)
+		parent->greaterChild = peak;
+	else
+		parent->lesserChild = peak;
+	
+	//the trail the rebuilt elements are on continues up through the elements on the same side of their parent
+	unsigned int source = peak;
+	for(int trailLevel = scapegoatLevel - 1;trailLevel > 0;--trailLevel){
+		compactTrailElement* trailAbove = elements + path[trailLevel];
+		if(isParentLesser)
+			trailAbove->higherTrailLength = elements[source].higherTrailLength + 1;
+		else
+			trailAbove->lowerTrailLength = elements[source].lowerTrailLength + 1;
+		
+		if((elements[path[trailLevel - 1]].greaterChild == path[trailLevel]) != isParentLesser)
+			break;
+		source = path[trailLevel];
+	}
+}
+
+
+//Insert a value into the tree under the superParent (element 0) as element newElement. Elements are taken from the element memory in order, so 
+	//newElement is also the number of elements in the tree
+void compactInsertVal(int value, compactTrailElement* elements, unsigned int newElement, unsigned int*& path, int& pathLength){
+	
+	//go down from the peak to where the value belongs, keeping the elements passed in the path
+	unsigned int comparisonElement = elements[0].greaterChild;
+	int level = 1;
+	path[0] = 0;
+	while(true){
+		if(level == pathLength){
+			unsigned int* longerPath = new unsigned int[2 * pathLength];
+			std::copy(path, path + pathLength, longerPath);
+			delete[] path;
+			path = longerPath;
+			pathLength *= 2;
+		}
+		path[level] = comparisonElement;
+		
+		unsigned int& child = (value >= elements[comparisonElement].val) ? elements[comparisonElement].greaterChild : elements[comparisonElement].lesserChild;
+		if(child == 0)
+			break;
+		comparisonElement = child;
+		++level;
+	}
+	
+	elements[newElement].val = value;
+	elements[newElement].lesserChild = 0;
+	elements[newElement].greaterChild = 0;
+	elements[newElement].lowerTrailLength = 0;
+	elements[newElement].higherTrailLength = 0;
+	
+	bool isTrailLesser = value >= elements[comparisonElement].val;
+	if(isTrailLesser)
+		elements[comparisonElement].greaterChild = newElement;
+	else
+		elements[comparisonElement].lesserChild = newElement;
+	
+	if(level + 1 > maxTrailDepth(newElement))
+		compactRebuildScapegoat(elements, path, level, newElement);
+	else
+		compactUpdateTree(elements, path, level, isTrailLesser);
+}
+
+
+//Transfer the values from the compact binary tree to the array
+void placeElementsInArray(const compactTrailElement* elements, unsigned int source, int* array, int& index){
+	if(elements[source].lesserChild != 0){
+		placeElementsInArray(elements, elements[source].lesserChild, array, index);
+	}
+	array[index] = elements[source].val;
+	index += 1;
+	if(elements[source].greaterChild != 0){
+		placeElementsInArray(elements, elements[source].greaterChild, array, index);
+	}
+}
+
+
+//Sort an array using elementMemory of at least arrayLength + 1 elements
+void compactTrailSort(int* array, int arrayLength, compactTrailElement* elementMemory){
+	if(arrayLength <= 1)
+		return;
+	
+	//the superParent has the first element as its greaterChild
+	elementMemory[0].lesserChild = 0;
+	elementMemory[0].greaterChild = 1;
+	elementMemory[1].val = array[0];
+	elementMemory[1].lesserChild = 0;
+	elementMemory[1].greaterChild = 0;
+	elementMemory[1].lowerTrailLength = 0;
+	elementMemory[1].higherTrailLength = 0;
+	
+	int pathLength = initialTrailPathLength;
+	unsigned int* path = new unsigned int[pathLength];
+	for(int i = 1;i < arrayLength;++i){
+		compactInsertVal(array[i], elementMemory, i + 1, path, pathLength);
+	}
+	delete[] path;
+	
+	int index = 0;
+	placeElementsInArray(elementMemory, elementMemory[0].greaterChild, array, index);
+}
+
+//Sort an array using the compact element layout
+void compactTrailSort(int* array, int arrayLength){
+	compactTrailElement* elementMemory = new compactTrailElement[arrayLength + 1];
+	compactTrailSort(array, arrayLength, elementMemory);
+	delete[] elementMemory;
+}
+
+
+
+
+/****************************************************************
+TRAIL INDEX******************************************************
+*****************************************************************
+-TrailIndex keeps trail sort's tree between operations, as an ordered multiset. Inserts are insertVal's, shifts and depth limit included, with 
+	elements taken from chunks and reused once erased rather than from one block sized for the whole array.
+-Erasing an element with two children erases the element after it instead (the first of its greater trail's lesser trail), moving its value up.
+	An element with one child or none is replaced by the child. That leaves the trails above it one shorter, so going up from there each element's
+	trail lengths are counted again from its children, and when one side has become 2 longer than the other, the child on that side becomes the 
+	parent: the inverse of the shift an insert makes when one side grows 2 longer.
+-The depth limit assumes the elements in the tree are about as many as have been in it. Once half of the most elements since the tree was last 
+	rebuilt are erased, the whole tree is rebuilt as a balanced tree.
+-The tree has parent pointers, so iterators are just an element, and move to the next or previous element through the trails. The end iterator
+	has no element, but keeps the superParent so that going back from it finds the last element.
+*****************************************************************/
+
+
+//Make source the greater (isParentLesser) or lesser child of its parent. Its trail lengths stay on the same sides, so trailLength and height swap
+void setParentDirection(trailElement* source, bool isParentLesser){
+	if(source->isParentLesser != isParentLesser){
+		std::swap(source->trailLength, source->height);
+		source->isParentLesser = isParentLesser;
+	}
+}
+
+//Set the trail lengths of source from its children
+void countTrailLengths(trailElement* source){
+	setTrailLengths(source, (source->lesserChild != nullptr) ? lowerTrailLength(source->lesserChild) + 1 : 0, 
+					(source->greaterChild != nullptr) ? higherTrailLength(source->greaterChild) + 1 : 0);
+}
+
+//Make child the parent of its parent, and return it
+trailElement* shiftUp(trailElement* child){
+	trailElement* parent = child->parent;
+	trailElement* grandparent = parent->parent;
+	bool isChildGreater = parent->greaterChild == child;
+	
+	if(parent->isParentLesser)
+		grandparent->greaterChild = child;
+	else
+		grandparent->lesserChild = child;
+	child->parent = grandparent;
+	setParentDirection(child, parent->isParentLesser);
+	
+	//the trail branching off the child towards the parent changes places, to branch off the parent
+	if(isChildGreater){
+		parent->greaterChild = child->lesserChild;
+		if(parent->greaterChild != nullptr){
+			parent->greaterChild->parent = parent;
+			setParentDirection(parent->greaterChild, true);
+		}
+		child->lesserChild = parent;
+		setParentDirection(parent, false);
+	}
+	else{
+		parent->lesserChild = child->greaterChild;
+		if(parent->lesserChild != nullptr){
+			parent->lesserChild->parent = parent;
+			setParentDirection(parent->lesserChild, false);
+		}
+		child->greaterChild = parent;
+		setParentDirection(parent, true);
+	}
+	parent->parent = child;
+	
+	countTrailLengths(parent);
+	countTrailLengths(child);
+	return child;
+}
+
+trailElement* firstElement(trailElement* source){
+	while(source->lesserChild != nullptr){
+		source = source->lesserChild;
+	}
+	return source;
+}
+
+trailElement* lastElement(trailElement* source){
+	while(source->greaterChild != nullptr){
+		source = source->greaterChild;
+	}
+	return source;
+}
+
+
+TrailIndex::TrailIndex(){
+	chunksLength = 16;
+	chunks = new trailElement*[chunksLength];
+	numChunks = 0;
+	freeElements = nullptr;
+	
+	superParent = newElement();
+	superParent->parent = nullptr;
+	superParent->lesserChild = nullptr;
+	superParent->greaterChild = nullptr;
+	superParent->trailLength = 0;
+	superParent->height = 0;
+	superParent->isParentLesser = false;
+	
+	count = 0;
+	rebuiltCount = 0;
+}
+
+TrailIndex::~TrailIndex(){
+	for(int i = 0;i < numChunks;++i){
+		delete[] chunks[i];
+	}
+	delete[] chunks;
+}
+
+
+//Get an unused element, allocating a chunk of them when there is none
+trailElement* TrailIndex::newElement(){
+	if(freeElements == nullptr){
+		if(numChunks == chunksLength){
+			trailElement** grownChunks = new trailElement*[2 * chunksLength];
+			std::copy(chunks, chunks + numChunks, grownChunks);
+			delete[] chunks;
+			chunks = grownChunks;
+			chunksLength *= 2;
+		}
+		trailElement* chunk = new trailElement[chunkElements];
+		chunks[numChunks++] = chunk;
+		for(int i = 0;i < chunkElements;++i){
+			releaseElement(chunk + i);
+		}
+	}
+	
+	trailElement* source = freeElements;
+	freeElements = source->parent;
+	return source;
+}
+
+void TrailIndex::releaseElement(trailElement* source){
+	source->parent = freeElements;
+	freeElements = source;
+}
+
+
+void TrailIndex::insert(int value){
+	trailElement* inserted = newElement();
+	++count;
+	rebuiltCount = std::max(rebuiltCount, count);
+	
+	if(superParent->greaterChild == nullptr){
+		superParent->greaterChild = inserted;
+		inserted->val = value;
+		inserted->parent = superParent;
+		inserted->lesserChild = nullptr;
+		inserted->greaterChild = nullptr;
+		inserted->trailLength = 0;
+		inserted->height = 0;
+		inserted->isParentLesser = true;
+		return;
+	}
+	
+	trailElement* elementAssigner = inserted;
+	insertVal(value, superParent->greaterChild, elementAssigner, count);
+}
+
+
+bool TrailIndex::erase(int value){
+	trailElement* source = find(value).current;
+	if(source == nullptr)
+		return false;
+	
+	//an element with two children takes the value of the next element, which has no lesser child, and that one is removed instead
+	if(source->lesserChild != nullptr && source->greaterChild != nullptr){
+		trailElement* next = firstElement(source->greaterChild);
+		source->val = next->val;
+		source = next;
+	}
+	
+	trailElement* child = (source->lesserChild != nullptr) ? source->lesserChild : source->greaterChild;
+	trailElement* parent = source->parent;
+	if(source->isParentLesser)
+		parent->greaterChild = child;
+	else
+		parent->lesserChild = child;
+	if(child != nullptr){
+		child->parent = parent;
+		setParentDirection(child, source->isParentLesser);
+	}
+	releaseElement(source);
+	--count;
+	
+	if(2 * count < rebuiltCount){
+		if(count > 0){
+			trailElement** elements = new trailElement*[count];
+			int index = 0;
+			listElements(superParent->greaterChild, elements, index);
+			superParent->greaterChild = buildBalancedTree(elements, count, superParent, true);
+			delete[] elements;
+		}
+		rebuiltCount = count;
+	}
+	else{
+		rebalance(parent);
+	}
+	return true;
+}
+
+//Count the trail lengths again from source up to the peak, shifting where one side has become 2 longer than the other
+void TrailIndex::rebalance(trailElement* source){
+	while(source->parent != nullptr){
+		countTrailLengths(source);
+		int lowerLength = lowerTrailLength(source);
+		int higherLength = higherTrailLength(source);
+		if(lowerLength - higherLength >= 2)
+			source = shiftUp(source->lesserChild);
+		else if(higherLength - lowerLength >= 2)
+			source = shiftUp(source->greaterChild);
+		source = source->parent;
+	}
+}
+
+
+TrailIndex::iterator TrailIndex::find(int value) const{
+	iterator location = end();
+	trailElement* comparisonElement = superParent->greaterChild;
+	while(comparisonElement != nullptr && comparisonElement->val != value){
+		comparisonElement = (value < comparisonElement->val) ? comparisonElement->lesserChild : comparisonElement->greaterChild;
+	}
+	location.current = comparisonElement;
+	return location;
+}
+
+TrailIndex::iterator TrailIndex::lowerBound(int value) const{
+	iterator location = end();
+	trailElement* comparisonElement = superParent->greaterChild;
+	while(comparisonElement != nullptr){
+		if(comparisonElement->val >= value){
+			location.current = comparisonElement;
+			comparisonElement = comparisonElement->lesserChild;
+		}
+		else{
+			comparisonElement = comparisonElement->greaterChild;
+		}
+	}
+	return location;
+}
+
+TrailIndex::iterator TrailIndex::successor(int value) const{
+	iterator location = end();
+	trailElement* comparisonElement = superParent->greaterChild;
+	while(comparisonElement != nullptr){
+		if(comparisonElement->val > value){
+			location.current = comparisonElement;
+			comparisonElement = comparisonElement->lesserChild;
+		}
+		else{
+			comparisonElement = comparisonElement->greaterChild;
+		}
+	}
+	return location;
+}
+
+TrailIndex::iterator TrailIndex::predecessor(int value) const{
+	iterator location = end();
+	trailElement* comparisonElement = superParent->greaterChild;
+	while(comparisonElement != nullptr){
+		if(comparisonElement->val < value){
+			location.current = comparisonElement;
+			comparisonElement = comparisonElement->greaterChild;
+		}
+		else{
+			comparisonElement = comparisonElement->lesserChild;
+		}
+	}
+	return location;
+}
+
+TrailIndex::iterator TrailIndex::begin() const{
+	iterator location = end();
+	if(superParent->greaterChild != nullptr)
+		location.current = firstElement(superParent->greaterChild);
+	return location;
+}
+
+TrailIndex::iterator TrailIndex::end() const{
+	iterator location;
+	location.superParent = superParent;
+	return location;
+}
+
+
+int TrailIndex::iterator::operator*() const{
+	return current->val;
+}
+
+//The next element is the first of the greater child's trail, or else the parent of the trail of greater children that current ends. Above the peak
+	//that is the superParent's parent, nullptr
+TrailIndex::iterator& TrailIndex::iterator::operator++(){
+	if(current->greaterChild != nullptr){
+		current = firstElement(current->greaterChild);
+	}
+	else{
+		while(current->isParentLesser){
+			current = current->parent;
+		}
+		current = current->parent;
+	}
+	return *this;
+}
+
+//The previous element is the last of the lesser child's trail, or else the parent of the trail of lesser children that current ends. Before the end
+	//it is the last of the peak's trail of greater children
+TrailIndex::iterator& TrailIndex::iterator::operator--(){
+	if(current == nullptr){
+		current = lastElement(superParent->greaterChild);
+	}
+	else if(current->lesserChild != nullptr){
+		current = lastElement(current->lesserChild);
+	}
+	else{
+		while(!current->isParentLesser){
+			current = current->parent;
+		}
+		current = current->parent;
+	}
+	return *this;
+}
@@ -0,0 +1,73 @@
+
+#ifndef trail_sort
+#define trail_sort
+
+struct trailElement; struct compactTrailElement;
+
+
+//Perform trail sort with internal allocation/deallocation of memory
+void trailSort(int* array, int arrayLength);
+//Perform trail sort with external allocation/deallocation of memory, of at least arrayLength + 1 elements
+void trailSort(int *array, int arrayLength, trailElement* elementAssigner);
+//Perform trail sort with 16 byte elements
+void compactTrailSort(int* array, int arrayLength);
+void compactTrailSort(int* array, int arrayLength, compactTrailElement* elementMemory);
+
+//Allocates memory for elements based on the array length
+void allocateMemory(int arrayLength, trailElement*& elementMemory);
+//Deallocates memory for elements
+void deallocateMemory(trailElement*& elementMemory);
+
+
+//Ordered multiset kept in trail sort's tree. Inserts shift the tree like trailSort, erases shift it back when a trail gets 2 shorter than the other
+	//side, and the depth is limited the same way
+class TrailIndex {
+	public:
+	//Bidirectional iterator over the values in sorted order, following the parent pointers
+	class iterator {
+		friend class TrailIndex;
+		trailElement* current;	//nullptr for the end iterator
+		trailElement* superParent;	//The index's, for going back from the end iterator to the last element
+
+		public:
+		iterator(){ current = nullptr; superParent = nullptr; }
+		int operator*() const;
+		iterator& operator++();
+		iterator& operator--();	//Not from begin(). From end() it goes to the last element
+		bool operator==(const iterator& other) const { return current == other.current; }
+		bool operator!=(const iterator& other) const { return current != other.current; }
+	};
+
+	TrailIndex();
+	~TrailIndex();
+	TrailIndex(const TrailIndex&) = delete;
+	TrailIndex& operator=(const TrailIndex&) = delete;
+
+	void insert(int value);
+	bool erase(int value);	//Erase one element equal to value, returns false if there is none
+	iterator find(int value) const;	//An element equal to value
+	iterator lowerBound(int value) const;	//First element not less than value
+	iterator successor(int value) const;	//First element greater than value
+	iterator predecessor(int value) const;	//Last element less than value
+	iterator begin() const;
+	iterator end() const;
+	int size() const { return count; }
+
+	private:
+	static const int chunkElements = 1024;
+
+	trailElement* superParent;	//Its greaterChild is the peak of the tree
+	int count;
+	int rebuiltCount;	//The most elements since the tree was last rebuilt as a whole. Once half are erased it is rebuilt again
+
+	trailElement* freeElements;	//Elements not in use, linked through parent
+	trailElement** chunks;
+	int numChunks;
+	int chunksLength;
+
+	trailElement* newElement();
+	void releaseElement(trailElement* source);
+	void rebalance(trailElement* source);
+};
+
+#endif